@@ -16,17 +16,22 @@
 
 #include <memory>
 #include <algorithm>
+#include <fstream>
+#include <vector>
 #include <unordered_set>
-#include <unordered_map>
 
 #include <boost/regex.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include "data.h"
+#include "pipeline.h"
 #include "channel.h"
+#include "broadcast.h"
+#include "spill.h"
 #include "mt.h"
 #include "helpers.h"
 #include "network.h"
+#include "stats.h"
 
 #define EOL                     "\r\n"
 
@@ -38,9 +43,9 @@ using namespace boost;
 
 typedef std::string Str;
 typedef std::pair<Str, Str> StrPair;
-typedef Channel<Str> ChanStr;
-typedef Channel<StrPair> ChanStrPair;
-typedef Channel<int> ChanInt;
+typedef SpillChannel<Str> SpillStr;
+typedef BroadcastChannel<StrPair> BroadcastStrPair;
+typedef Emitter<Str> EmitStr;
 
 template<typename T>
 Str toStr(const T& t)
@@ -81,12 +86,13 @@ StrPair parseUrl(const Str& url)
     return {host, path};
 }
 
-void parseHref(const StrPair& data, ChanStr& c)
+std::vector<Str> parseHref(const StrPair& data)
 {
     static const regex e("href *= *\"([http://[\\w\\d\\._-]*[\\w\\d_-]+]?/[\\?\\&\\d\\w\\[\\]\\@\\!\\$\\'\\(\\)\\*\\+\\.%,;:/#=~_-]*)\"", regex::icase);
     auto&& host = data.first;
     auto&& body = data.second;
 
+    std::vector<Str> urls;
     sregex_token_iterator i = make_regex_token_iterator(body, e, 1);
     sregex_token_iterator ie;
     while (i != ie)
@@ -95,11 +101,12 @@ void parseHref(const StrPair& data, ChanStr& c)
         VERIFY(!url.empty(), "Empty parsed url");
         if (url[0] == '/')
             url = "http://" + host + url;
-        c.put(url);
+        urls.push_back(std::move(url));
     }
+    return urls;
 }
 
-void parseText(const Str& content, ChanStr& para)
+void parseText(const Str& content, EmitStr& para)
 {
     static const regex e("<p>(.*?)</p>");
     sregex_token_iterator i = make_regex_token_iterator(content, e, 1);
@@ -110,7 +117,7 @@ void parseText(const Str& content, ChanStr& para)
     }
 }
 
-void excludeTags(const Str& para, ChanStr& text)
+void excludeTags(const Str& para, EmitStr& text)
 {
     static const regex e("(<.*?>)");
     sregex_token_iterator i = make_regex_token_iterator(para, e, 1);
@@ -124,7 +131,7 @@ void excludeTags(const Str& para, ChanStr& text)
     text.put({s, para.end()});
 }
 
-void splitWords(const Str& text, ChanStr& words)
+void splitWords(const Str& text, EmitStr& words)
 {
     static const regex e("([a-zA-Z]+)");
     sregex_token_iterator i = make_regex_token_iterator(text, e, 1);
@@ -224,6 +231,23 @@ StrPair loadContent(const StrPair& url)
     return {host, body};
 }
 
+// the page is passed even on failure with the empty body
+// thus each loaded url reaches the href stage
+StrPair loadPage(const StrPair& url)
+{
+    if (isEmpty(url))
+        return {};
+    try
+    {
+        return loadContent(url);
+    }
+    catch (std::exception& e)
+    {
+        JLOG("cannot load url: " << e.what());
+        return {url.first, {}};
+    }
+}
+
 void processing()
 {
     int threads = std::thread::hardware_concurrency();
@@ -231,53 +255,74 @@ void processing()
     ThreadPool tp(threads, "tp");
     scheduler<DefaultTag>().attach(tp);
     service<NetworkTag>().attach(tp);
+    service<TimeoutTag>().attach(tp);
 
-    ChanStr url;
-    ChanStr filteredUrl;
-    ChanStrPair parsedUrl;
-    ChanStrPair content;
-    ChanStrPair contentHref;
-    ChanStr contentText;
-    ChanStr contentParagraph;
-    ChanStr text;
-    ChanStr words;
-    
-    UrlFilter urlFilter("boost.org", 1000);
-    
-    piping1to01(url, filteredUrl, urlFilter);
-    piping1to01(filteredUrl, parsedUrl, parseUrl);
-    piping1to1(parsedUrl, content, loadContent, 50);
-    go([&] {
-        auto c1 = closer(contentHref);
-        auto c2 = closer(contentText);
-        for (auto&& c: content)
-        {
-            contentHref.put(c);
-            contentText.put(c.second);
-        }
-    });
-    piping1toMany(contentHref, url, parseHref);
-    piping1toMany(contentText, contentParagraph, parseText);
-    piping1toMany(contentParagraph, text, excludeTags);
-    piping1toMany(text, words, splitWords);
+    // the url frontier may exceed the memory thus it is spilled to disk;
+    // each url in flight is registered as the producer of the frontier:
+    // it is released when the url is filtered out or its hrefs are put,
+    // thus the frontier is closed when the crawling is completed
+    SpillStr url("url.frontier");
+    // the page content is shared by href and text processing without copying
+    BroadcastStrPair content;
+    auto& contentHref = content.subscribe();
+    auto& contentText = content.subscribe();
     
-    std::unordered_map<Str, int> countedWords;
+    // the urls are partitioned by the hash thus each filter keeps its own set
+    UrlFilter urlFilter("boost.org", 1000 / threads);
+    Channel<Str> newUrl;
+    Channel<Str> words;
+    // the loading waits for the network thus the amount of the journeys
+    // is adjusted by the backlog of the parsed urls
+    Adaptive loading(1, 100);
+    Channel<std::pair<Str, size_t>> countedWords;
+    std::vector<std::pair<Str, size_t>> wordsOut;
     
-    go([&] {
-        for (auto&& c: words)
-        {
-            boost::algorithm::to_lower(c);
-            ++ countedWords[c];
-        }
+    // the sequential stages are fused, the named stages are profiled
+    pipingKeyed(url, newUrl, [](const Str& u) -> const Str& { return u; },
+        [urlFilter, &url](Channel<Str>& s, Channel<Str>& d) {
+            for (auto&& u: s)
+            {
+                Str r = urlFilter(u);
+                if (!r.empty())
+                    d.put(std::move(r));
+                else
+                    url.releaseProducer();
+            }
+        }, threads, DEFAULT_ROUTE_BATCH, "route");
+    from(newUrl) | (map(parseUrl) | map(loadPage)).adaptive(loading, "load") | to(content);
+    from(contentHref) | sink([&url](const StrPair& page) {
+        auto hrefs = parseHref(page);
+        url.addProducer(hrefs.size());
+        for (auto&& h: hrefs)
+            url.put(std::move(h));
+        url.releaseProducer();
+    }, "href");
+    // the text processing is stateless thus the whole chain runs in parallel
+    from(contentText)
+        | (flatMap<Str>([](const StrPair& c, EmitStr& para) { parseText(c.second, para); })
+            | flatMap<Str>(excludeTags)
+            | flatMap<Str>(splitWords)
+            | map([](Str& w) { boost::algorithm::to_lower(w); return std::move(w); })).parallel(threads, "text")
+        | to(words);
+    // each worker counts into its own partial map
+    countByKey(words, countedWords, threads, "count");
+    from(countedWords) | sink([&wordsOut](std::pair<Str, size_t>& w) {
+        wordsOut.push_back(std::move(w));
     });
     
+    url.addProducer();
     url.put("http://www.boost.org");
-    closeAndWait(tp, url);
+    // the pool is never idle while the adaptive controller ticks
+    waitForAll();
+    STATS(
+        stats::dump();
+        std::ofstream("stages.dot") << stats::stagesDot();
+    )
+    auto l = loading.snapshot();
+    RTLOG("loading: peak workers " << l.peakWorkers << ", scale ups " << l.scaleUps
+        << ", rejected " << l.rejected << ", scale downs " << l.scaleDowns);
     static const size_t WORDS_COUNT = 20;
-    std::vector<std::pair<Str, int>> wordsOut;
-    typedef std::vector<std::pair<Str, int>>::const_reference CRef;
-    for (auto&& i: countedWords)
-        wordsOut.push_back(i);
+    typedef std::vector<std::pair<Str, size_t>>::const_reference CRef;
     RTLOG("added");
     auto nth = std::min(WORDS_COUNT, wordsOut.size());
     auto sortFn = [](CRef l, CRef r) { return l.second > r.second; };
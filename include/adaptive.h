@@ -0,0 +1,103 @@
+/*
+ * Copyright 2014 Grigory Demchenko (aka gridem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "stats.h"
+
+namespace synca {
+namespace data {
+
+const int DEFAULT_ADAPTIVE_TICK_MS = 100;
+
+enum RetireStatus
+{
+    RS_KEEP,                    // the worker continues
+    RS_RETIRED,
+    RS_LAST,                    // the last worker is retired
+};
+
+struct AdaptiveSnapshot
+{
+    int workers;
+    int peakWorkers;
+    uint64_t depth;             // backlog of the source on the last tick
+    uint64_t processed;
+    double throughput;          // values per second during the last tick
+    uint64_t latencyNs;         // average processing time of the value
+    uint64_t scaleUps;
+    uint64_t scaleDowns;
+    uint64_t rejected;          // scale ups reverted due to no throughput gain
+};
+
+// controller of the adaptive stage: on each tick the backlog and the latency of the stage
+// estimate the workers needed for the arrival rate (Little's law), the scale up is kept
+// only if it increases the throughput thus the oversubscription of the thread pool
+// is reverted, the idle workers are retired down to the minimum; single use only
+struct Adaptive
+{
+    Adaptive(int minWorkers, int maxWorkers, int tickMs = DEFAULT_ADAPTIVE_TICK_MS);
+
+    AdaptiveSnapshot snapshot() const;
+
+    const int minWorkers;
+    const int maxWorkers;
+    const int tickMs;
+
+    // the stage side
+    void start();
+    void processed(uint64_t ns);
+    // the worker must exit unless RS_KEEP
+    RetireStatus retire();
+    // registers the spawned worker, false if the stage is completed
+    bool enter();
+    // true if the last worker is left
+    bool leave();
+
+    // the controller side, returns the amount of the workers to spawn
+    int decide(size_t depth);
+    // the tick of dt seconds, does not depend on the clock
+    int decide(size_t depth, double dt);
+
+private:
+    void peak(int workers);
+
+    std::atomic<int> active{0};
+    std::atomic<int> excess{0};
+    std::atomic<int> peakWorkers{0};
+    std::atomic<uint64_t> processedCount{0};
+    std::atomic<uint64_t> busyNs{0};
+    std::atomic<uint64_t> lastDepth{0};
+    std::atomic<uint64_t> throughput{0};
+    std::atomic<uint64_t> latencyNs{0};
+    std::atomic<uint64_t> scaleUps{0};
+    std::atomic<uint64_t> scaleDowns{0};
+    std::atomic<uint64_t> rejected{0};
+
+    // the controller state
+    stats::TimePoint lastTick;
+    uint64_t lastProcessed = 0;
+    uint64_t lastBusy = 0;
+    double baseThroughput = 0;
+    int probe = 0;
+    bool settle = false;
+    int hold = 0;
+};
+
+}}
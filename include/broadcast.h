@@ -0,0 +1,245 @@
+/*
+ * Copyright 2014 Grigory Demchenko (aka gridem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <list>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+
+#include "core.h"
+#include "helpers.h"
+#include "ring.h"
+#include "waiters.h"
+
+namespace synca {
+
+enum OverflowPolicy
+{
+    OP_BLOCK,           // the publisher waits for the slowest subscriber
+    OP_DROP_OLDEST,     // the slowest subscribers lose the oldest values
+};
+
+// each subscriber has its own cursor into the shared ring of immutable values,
+// the values are not copied: the subscribers share the same pointer
+template<typename T>
+struct BroadcastChannel : Producers<BroadcastChannel<T>>
+{
+    typedef std::shared_ptr<const T> Ptr;
+
+private:
+    typedef detail::Waiter<Ptr> Waiter;
+    typedef detail::Waiters<Waiter> Waiters;
+    typedef std::unique_lock<std::mutex> Lock;
+
+public:
+    // several journeys may consume the same subscription
+    struct Subscriber
+    {
+        struct Iterator
+        {
+            Iterator() = default;
+            Iterator(Subscriber& s) : sub(&s)        { ++*this; }
+
+            const T& operator*()                     { return *val; }
+            Iterator& operator++()                   { if (!sub->get(val)) sub = nullptr; return *this; }
+            bool operator!=(const Iterator& i) const { return sub != i.sub; }
+        private:
+            Ptr val;
+            Subscriber* sub = nullptr;
+        };
+
+        Subscriber(BroadcastChannel& c, uint64_t pos) : ch(c), cursor(pos) {}
+
+        Iterator begin()                             { return {*this}; }
+        static Iterator end()                        { return {}; }
+
+        bool get(Ptr& val)
+        {
+            return ch.get0(*this, val);
+        }
+
+        BroadcastChannel& channel()
+        {
+            return ch;
+        }
+
+        // the values lost due to OP_DROP_OLDEST policy
+        uint64_t dropped() const
+        {
+            Lock lock(ch.mutex);
+            return drops;
+        }
+
+    private:
+        friend struct BroadcastChannel;
+
+        BroadcastChannel& ch;
+        uint64_t cursor;
+        uint64_t drops = 0;
+        Waiters getters;
+    };
+
+    explicit BroadcastChannel(size_t capacity = DEFAULT_RING_CAPACITY, OverflowPolicy policy_ = OP_BLOCK) :
+        slots(detail::roundUpToPowerOf2(capacity)), mask(slots.size() - 1), policy(policy_)
+    {
+    }
+
+    // receives the values put after the subscription
+    Subscriber& subscribe()
+    {
+        Lock lock(mutex);
+        subscribers.emplace_back(*this, tail);
+        return subscribers.back();
+    }
+
+    void unsubscribe(Subscriber& s)
+    {
+        Lock lock(mutex);
+        Waiters gs = s.getters.popAll();
+        subscribers.remove_if([&s](const Subscriber& x) { return &x == &s; });
+        Waiters ps = advance0();
+        lock.unlock();
+        gs.cancelAll();
+        ps.proceedAll();
+    }
+
+    bool put(T val)
+    {
+        return publish(std::make_shared<const T>(std::move(val)));
+    }
+
+    // returns false if the channel is closed
+    bool publish(Ptr val)
+    {
+        Lock lock(mutex);
+        while (full0())
+        {
+            if (closed)
+                return false;
+            if (policy == OP_DROP_OLDEST)
+            {
+                drop0();
+                break;
+            }
+            Waiter w(val);
+            detail::suspend(lock, putters, w);
+            if (w.val == nullptr)
+                return false;
+            lock = Lock(mutex);
+        }
+        if (closed)
+            return false;
+        if (subscribers.empty())
+            return true;
+        slots[tail & mask] = std::move(val);
+        ++ tail;
+        Waiters ready;
+        for (auto&& s: subscribers)
+        {
+            while (s.cursor < tail)
+            {
+                Waiter* w = s.getters.pop();
+                if (w == nullptr)
+                    break;
+                *w->val = slots[s.cursor ++ & mask];
+                ready.push(*w);
+            }
+        }
+        ready.append(advance0());
+        lock.unlock();
+        ready.proceedAll();
+        return true;
+    }
+
+    void close()
+    {
+        Lock lock(mutex);
+        if (closed)
+            return;
+        closed = true;
+        Waiters ws = putters.popAll();
+        for (auto&& s: subscribers)
+            ws.append(s.getters.popAll());
+        lock.unlock();
+        ws.cancelAll();
+    }
+
+private:
+    bool get0(Subscriber& s, Ptr& val)
+    {
+        Lock lock(mutex);
+        if (s.cursor < tail)
+        {
+            val = slots[s.cursor ++ & mask];
+            Waiters ps = advance0();
+            lock.unlock();
+            ps.proceedAll();
+            return true;
+        }
+        if (closed)
+            return false;
+        Waiter w(val);
+        detail::suspend(lock, s.getters, w);
+        return w.val != nullptr;
+    }
+
+    bool full0() const
+    {
+        return tail - head > mask;
+    }
+
+    // releases the values consumed by all subscribers,
+    // returns the putters to recheck the space
+    Waiters advance0()
+    {
+        uint64_t minCursor = tail;
+        for (auto&& s: subscribers)
+            minCursor = std::min(minCursor, s.cursor);
+        if (minCursor == head)
+            return {};
+        for (; head < minCursor; ++ head)
+            slots[head & mask].reset();
+        return putters.popAll();
+    }
+
+    void drop0()
+    {
+        for (auto&& s: subscribers)
+        {
+            if (s.cursor == head)
+            {
+                ++ s.cursor;
+                ++ s.drops;
+            }
+        }
+        advance0();
+    }
+
+    std::vector<Ptr> slots;
+    const uint64_t mask;
+    uint64_t head = 0;
+    uint64_t tail = 0;
+    OverflowPolicy policy;
+    std::list<Subscriber> subscribers;
+    Waiters putters;
+    mutable std::mutex mutex;
+    bool closed = false;
+};
+
+}
@@ -18,15 +18,111 @@
 
 #include <queue>
 #include <mutex>
+#include <vector>
+#include <limits>
+#include <type_traits>
+#include <boost/optional.hpp>
 
 #include "core.h"
 #include "helpers.h"
+#include "ring.h"
+#include "stats.h"
 
 namespace synca {
 
-// with iterators
+namespace detail {
+
+// the state shared by the waiters of the single select
+struct SelectState
+{
+    static const int NONE = -2;
+    static const int TIMEDOUT = -1;
+
+    // the first claimed case wins, the claim is idempotent for the winner
+    bool claim(int index)
+    {
+        int expected = NONE;
+        return fired.compare_exchange_strong(expected, index) || expected == index;
+    }
+
+    // proceeds after both the registration and the firing are completed
+    void done()
+    {
+        if (-- pending == 0)
+        {
+            Handler proceed = std::move(proc);
+            proceed();
+        }
+    }
+
+    std::atomic<int> fired{NONE};
+    std::atomic<int> pending{2};
+    Handler proc;
+};
+
+struct SelectCase
+{
+    virtual ~SelectCase() {}
+
+    // returns false if the select is completed by the case or another case has fired
+    virtual bool enlist(SelectState& s, int index) = 0;
+    virtual void delist() = 0;
+    virtual bool ok() const = 0;
+    // called for the selected case only
+    virtual void complete() {}
+    // completes the case without the suspension if the channel is ready
+    virtual bool poll() { return false; }
+};
+
+// suspends the journey until one of the cases is ready or the timeout (if not negative)
+// is expired, returns the index of the selected case or SelectState::TIMEDOUT
+int waitCases(const std::vector<SelectCase*>& cases, int timeoutMs);
+int waitCasesUs(const std::vector<SelectCase*>& cases, int64_t timeoutUs);
+
+// the element of the rvalue range is moved, of the lvalue range is copied
+template<typename T_range, typename T_value>
+typename std::conditional<std::is_lvalue_reference<T_range>::value, T_value&, T_value&&>::type
+element(T_value& v)
+{
+    return static_cast<typename std::conditional<
+        std::is_lvalue_reference<T_range>::value, T_value&, T_value&&>::type>(v);
+}
+
+// the destination is either the value or boost::optional of the value
+template<typename T, typename T_dst = T>
+struct SelectGet;
+
 template<typename T>
-struct Channel
+struct SelectPut;
+
+}
+
+// the order of proceeding the suspended journeys
+enum WakeupOrder
+{
+    WO_LIFO,    // the most recent waiter is proceeded first: hot caches
+    WO_FIFO,    // the oldest waiter is proceeded first: fairness
+};
+
+enum ChannelStatus
+{
+    CS_OK,
+    CS_EMPTY,
+    CS_FULL,
+    CS_CLOSED,
+    CS_TIMEDOUT,
+};
+
+// channel policies
+struct Locked;  // mutex based queue, multiple producers and consumers
+struct Spsc;    // lock-free ring, single producer and single consumer
+
+template<typename T, typename T_policy = Locked>
+struct Channel;
+
+// with iterators, capacity 0 means unbounded channel
+template<typename T>
+struct Channel<T, Locked> : Producers<Channel<T, Locked>>
 {
 private:
     struct Waiters;
@@ -34,20 +130,61 @@ private:
     {
         friend struct Waiters;
         
+        // putter
         Waiter(T& v) : val(&v) {}
         
+        // getter, the value is constructed in place
+        Waiter(boost::optional<T>& v) : out(&v) {}
+        
+        // the waiter is a case of the select
+        void select(detail::SelectState& s, int i)
+        {
+            state = &s;
+            index = i;
+            proc = [&s] {
+                s.done();
+            };
+        }
+        
+        // the waiter of the select may be already fired by another case
+        bool claim()
+        {
+            return state == nullptr || state->claim(index);
+        }
+        
+        // getter receives the value
         void proceed(T&& v)
         {
-            *val = std::move(v);
+            set(std::move(v));
             proc();
         }
 
+        // getter receives the value, proceeds later
+        template<typename... T_args>
+        void set(T_args&&... args)
+        {
+            out->emplace(std::forward<T_args>(args)...);
+        }
+
+        // putter value has been taken
         void proceed()
+        {
+            proc();
+        }
+
+        // channel is closed
+        void cancel()
         {
             val = nullptr;
+            out = nullptr;
             proc();
         }
         
+        T&& take()
+        {
+            return std::move(*val);
+        }
+        
         void setProceed(Handler&& proceed)
         {
             proc = std::move(proceed);
@@ -55,31 +192,40 @@ private:
         
         bool hasValue() const
         {
-            return val != nullptr;
+            return val != nullptr || out != nullptr;
         }
         
     private:
         Handler proc;
         Waiter* next = nullptr;
-        T* val;
+        T* val = nullptr;
+        boost::optional<T>* out = nullptr;
+        detail::SelectState* state = nullptr;
+        int index = 0;
     };
     
     struct Waiters
     {
+        // skips the waiters of the fired selects
         Waiter* pop()
         {
-            if (!root)
-                return nullptr;
-            Waiter* w = root;
-            root = root->next;
-            return w;
+            while (root)
+            {
+                Waiter* w = root;
+                root = root->next;
+                if (!root)
+                    last = nullptr;
+                if (w->claim())
+                    return w;
+            }
+            return nullptr;
         }
         
         Waiters popAll()
         {
-            Waiters w;
-            w.root = root;
+            Waiters w = *this;
             root = nullptr;
+            last = nullptr;
             return w;
         }
         
@@ -87,78 +233,366 @@ private:
         {
             w.next = root;
             root = &w;
+            if (!last)
+                last = &w;
+        }
+        
+        void pushBack(Waiter& w)
+        {
+            w.next = nullptr;
+            if (last)
+                last->next = &w;
+            else
+                root = &w;
+            last = &w;
+        }
+        
+        void remove(Waiter& w)
+        {
+            Waiter* prev = nullptr;
+            for (Waiter* p = root; p; prev = p, p = p->next)
+            {
+                if (p == &w)
+                {
+                    (prev ? prev->next : root) = w.next;
+                    if (last == &w)
+                        last = prev;
+                    return;
+                }
+            }
+        }
+        
+        bool empty() const
+        {
+            return root == nullptr;
+        }
+        
+        void proceedAll()
+        {
+            for (Waiter* w = pop(); w; w = pop())
+                w->proceed();
         }
         
     private:
         Waiter* root = nullptr;
+        Waiter* last = nullptr;
     };
     
     typedef std::unique_lock<std::mutex> Lock;
     
+    template<typename U, typename U_dst>
+    friend struct detail::SelectGet;
+    template<typename U>
+    friend struct detail::SelectPut;
+    
 public:
     struct Iterator
     {
         Iterator() = default;
         Iterator(Channel& c) : ch(&c)            { ++*this; }
 
-        T& operator*()                           { return val; }
-        Iterator& operator++()                   { if (!ch->get(val)) ch = nullptr; return *this; }
+        T& operator*()                           { return *val; }
+        Iterator& operator++()                   { val = boost::none; if (!ch->get(val)) ch = nullptr; return *this; }
         bool operator!=(const Iterator& i) const { return ch != i.ch; }
     private:
-        T val;
+        boost::optional<T> val;
         Channel* ch = nullptr;
     };
     
+    // yields the available values by batches
+    struct BatchIterator
+    {
+        BatchIterator() = default;
+        BatchIterator(Channel& c, size_t n) : ch(&c), maxCount(n) { ++*this; }
+
+        std::vector<T>& operator*()              { return vals; }
+        BatchIterator& operator++()              { vals.clear(); if (!ch->getMany(vals, maxCount)) ch = nullptr; return *this; }
+        bool operator!=(const BatchIterator& i) const { return ch != i.ch; }
+    private:
+        std::vector<T> vals;
+        Channel* ch = nullptr;
+        size_t maxCount = 0;
+    };
+    
+    struct Batches
+    {
+        BatchIterator begin()                    { return {ch, maxCount}; }
+        static BatchIterator end()               { return {}; }
+
+        Channel& ch;
+        size_t maxCount;
+    };
+    
+    explicit Channel(size_t capacity_ = 0, WakeupOrder order_ = WO_LIFO) :
+        capacity(capacity_), order(order_)
+    {
+    }
+    
+    STATS(
+    ~Channel()
+    {
+        stats::unregisterChannel(st);
+    }
+    )
+    
+    // the named channel is enumerated by stats::channels
+    void name(const char* n)
+    {
+        STATS(stats::registerChannel(st, n);)
+        (void) n;
+    }
+
     Iterator begin()                             { return {*this}; }
     static Iterator end()                        { return {}; }
     
-    void put(T val)
+    Batches batches(size_t maxCount = std::numeric_limits<size_t>::max())
+    {
+        return {*this, maxCount};
+    }
+    
+    // suspends the journey while the bounded channel is full,
+    // returns false if the value is not put due to closing
+    bool put(T val)
+    {
+        return emplace(std::move(val));
+    }
+    
+    // constructs the value directly in the queue or in the storage of the getter,
+    // the value is constructed before the suspension if the channel is full
+    template<typename... T_args>
+    bool emplace(T_args&&... args)
     {
         Lock lock(mutex);
-        Waiter* w = waiters.pop();
+        Waiter* w = getters.pop();
         if (w) 
         {
+            handed0();
             lock.unlock();
-            w->proceed(std::move(val));
+            w->set(std::forward<T_args>(args)...);
+            w->proceed();
+            return true;
         }
-        else
+        if (!full0())
         {
-            queue.emplace(std::move(val));
+            queue.emplace(std::forward<T_args>(args)...);
+            pushed0();
+            return true;
         }
+        if (closed)
+            return false;
+        T val(std::forward<T_args>(args)...);
+        Waiter p(val);
+        wait0(lock, putters, p);
+        return p.hasValue();
     }
     
     bool get(T& val)
+    {
+        boost::optional<T> v;
+        if (!get(v))
+            return false;
+        val = std::move(*v);
+        return true;
+    }
+    
+    // supports move-only and not default constructible values
+    bool get(boost::optional<T>& val)
     {
         Lock lock(mutex);
         if (!queue.empty())
         {
-            val = std::move(queue.front());
+            val.emplace(std::move(queue.front()));
             queue.pop();
+            popped0();
+            Waiter* p = putters.pop();
+            if (p)
+            {
+                queue.emplace(p->take());
+                pushed0();
+                lock.unlock();
+                p->proceed();
+            }
             return true;
         }
         if (closed)
             return false;
         Waiter w(val);
-        waiters.push(w);
-        lock.release();
-        deferProceed([this, &w](Handler proceed) {
-            w.setProceed(std::move(proceed));
-            mutex.unlock();
-        });
+        wait0(lock, getters, w);
         return w.hasValue();
     }
     
+    // puts the whole range using single lock acquisition while there is a space,
+    // returns the amount of the values put; the values of the rvalue range are moved,
+    // of the lvalue range are copied
+    template<typename T_range>
+    size_t putMany(T_range&& values)
+    {
+        size_t count = 0;
+        auto it = std::begin(values);
+        auto end = std::end(values);
+        while (it != end)
+        {
+            Lock lock(mutex);
+            Waiters ready;
+            for (; it != end; ++ it, ++ count)
+            {
+                Waiter* w = getters.pop();
+                if (w)
+                {
+                    handed0();
+                    w->set(detail::element<T_range>(*it));
+                    ready.push(*w);
+                }
+                else if (!full0())
+                {
+                    queue.emplace(detail::element<T_range>(*it));
+                    pushed0();
+                }
+                else
+                    break;
+            }
+            if (!ready.empty() || it == end)
+            {
+                lock.unlock();
+                ready.proceedAll();
+                continue;
+            }
+            if (closed)
+                break;
+            T val = detail::element<T_range>(*it);
+            Waiter p(val);
+            wait0(lock, putters, p);
+            if (!p.hasValue())
+                break;
+            ++ it;
+            ++ count;
+        }
+        return count;
+    }
+    
+    // appends at least one and at most maxCount values,
+    // returns 0 if the channel is closed and empty
+    size_t getMany(std::vector<T>& vals, size_t maxCount = std::numeric_limits<size_t>::max())
+    {
+        Lock lock(mutex);
+        if (!queue.empty())
+            return take0(lock, vals, maxCount);
+        if (closed)
+            return 0;
+        boost::optional<T> val;
+        Waiter w(val);
+        wait0(lock, getters, w);
+        if (!w.hasValue())
+            return 0;
+        vals.push_back(std::move(*val));
+        if (maxCount == 1)
+            return 1;
+        lock = Lock(mutex);
+        return 1 + take0(lock, vals, maxCount - 1);
+    }
+    
+    // like getMany but after the first value waits for the rest at most us microseconds:
+    // the queued values are drained first, the journey is suspended only if they are
+    // not enough to fill maxCount
+    size_t getManyFor(std::vector<T>& vals, size_t maxCount, int us)
+    {
+        size_t count = getMany(vals, maxCount);
+        bool timed = false;
+        stats::TimePoint deadline;
+        while (count > 0 && count < maxCount)
+        {
+            Lock lock(mutex);
+            if (!queue.empty())
+            {
+                count += take0(lock, vals, maxCount - count);
+                continue;
+            }
+            if (closed || us <= 0)
+                break;
+            lock.unlock();
+            if (!timed)
+            {
+                deadline = stats::now() + std::chrono::microseconds(us);
+                timed = true;
+            }
+            int64_t left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - stats::now()).count();
+            if (left <= 0)
+                break;
+            // the value type may be not default constructible
+            boost::optional<T> val;
+            detail::SelectGet<T, boost::optional<T>> c(*this, val);
+            if (detail::waitCasesUs({&c}, left) == detail::SelectState::TIMEDOUT || !c.ok())
+                break;
+            vals.push_back(std::move(*val));
+            ++ count;
+        }
+        return count;
+    }
+    
+    // nonblocking operations, the value is not moved if the status is not CS_OK
+    ChannelStatus tryGet(T& val)
+    {
+        return tryGet0(val);
+    }
+
+    ChannelStatus tryGet(boost::optional<T>& val)
+    {
+        return tryGet0(val);
+    }
+    
+    ChannelStatus tryPut(T&& val)
+    {
+        Lock lock(mutex);
+        if (closed)
+            return CS_CLOSED;
+        Waiter* w = getters.pop();
+        if (w)
+        {
+            handed0();
+            lock.unlock();
+            w->proceed(std::move(val));
+            return CS_OK;
+        }
+        if (!full0())
+        {
+            queue.emplace(std::move(val));
+            pushed0();
+            return CS_OK;
+        }
+        return CS_FULL;
+    }
+    
+    // suspends the journey at most ms milliseconds, the waiter is removed
+    // from the channel on timeout without the journey events
+    ChannelStatus getFor(T& val, int ms)
+    {
+        ChannelStatus s = tryGet(val);
+        if (s != CS_EMPTY)
+            return s;
+        detail::SelectGet<T> c(*this, val);
+        if (detail::waitCases({&c}, ms) == detail::SelectState::TIMEDOUT)
+            return CS_TIMEDOUT;
+        return c.ok() ? CS_OK : CS_CLOSED;
+    }
+    
     bool empty() const
     {
         Lock lock(mutex);
         return queue.empty();
     }
+
+    // amount of the queued values
+    size_t size() const
+    {
+        Lock lock(mutex);
+        return queue.size();
+    }
     
     T get()
     {
-        T val;
+        boost::optional<T> val;
         get(val);
-        return val;
+        return val ? std::move(*val) : T();
     }
     
     void open()
@@ -167,23 +601,423 @@ public:
         closed = false;
     }
     
+    // proceeds both getters and putters
     void close()
     {
         Lock lock(mutex);
         if (closed)
             return;
         closed = true;
-        Waiters ws = waiters.popAll();
+        Waiters gs = getters.popAll();
+        Waiters ps = putters.popAll();
         lock.unlock();
-        for (Waiter* w = ws.pop(); w; w = ws.pop())
-            w->proceed();
+        for (Waiter* w = gs.pop(); w; w = gs.pop())
+            w->cancel();
+        for (Waiter* w = ps.pop(); w; w = ps.pop())
+            w->cancel();
     }
     
 private:
-    Waiters waiters;
+    bool full0() const
+    {
+        return capacity != 0 && queue.size() >= capacity;
+    }
+
+    // select support: returns true if the waiter is enlisted,
+    // otherwise the case is either completed or lost
+    bool enlistGet0(Waiter& w)
+    {
+        Lock lock(mutex);
+        if (queue.empty() && !closed)
+        {
+            add0(getters, w);
+            return true;
+        }
+        if (!w.claim())
+            return false;
+        if (queue.empty())
+        {
+            lock.unlock();
+            w.cancel();
+            return false;
+        }
+        T val = std::move(queue.front());
+        queue.pop();
+        popped0();
+        Waiter* p = putters.pop();
+        if (p)
+        {
+            queue.emplace(p->take());
+            pushed0();
+        }
+        lock.unlock();
+        if (p)
+            p->proceed();
+        w.proceed(std::move(val));
+        return false;
+    }
+
+    bool enlistPut0(Waiter& w)
+    {
+        Lock lock(mutex);
+        if (full0() && !closed)
+        {
+            add0(putters, w);
+            return true;
+        }
+        if (!w.claim())
+            return false;
+        if (closed)
+        {
+            lock.unlock();
+            w.cancel();
+            return false;
+        }
+        Waiter* g = getters.pop();
+        if (g)
+        {
+            handed0();
+            lock.unlock();
+            g->proceed(w.take());
+            w.proceed();
+            return false;
+        }
+        queue.emplace(w.take());
+        pushed0();
+        lock.unlock();
+        w.proceed();
+        return false;
+    }
+
+    void delist0(Waiter& w)
+    {
+        Lock lock(mutex);
+        getters.remove(w);
+        putters.remove(w);
+    }
+
+    // the destination is the value or boost::optional of the value
+    template<typename T_dst>
+    ChannelStatus tryGet0(T_dst& val)
+    {
+        Lock lock(mutex);
+        if (queue.empty())
+            return closed ? CS_CLOSED : CS_EMPTY;
+        val = std::move(queue.front());
+        queue.pop();
+        popped0();
+        Waiter* p = putters.pop();
+        if (p)
+        {
+            queue.emplace(p->take());
+            pushed0();
+            lock.unlock();
+            p->proceed();
+        }
+        return CS_OK;
+    }
+
+    // the putters are proceeded after the unlock
+    size_t take0(Lock& lock, std::vector<T>& vals, size_t maxCount)
+    {
+        size_t count = 0;
+        Waiters ready;
+        for (; count < maxCount && !queue.empty(); ++ count)
+        {
+            vals.push_back(std::move(queue.front()));
+            queue.pop();
+            popped0();
+            Waiter* p = putters.pop();
+            if (p)
+            {
+                queue.emplace(p->take());
+                pushed0();
+                ready.push(*p);
+            }
+        }
+        lock.unlock();
+        ready.proceedAll();
+        return count;
+    }
+
+    void add0(Waiters& ws, Waiter& w)
+    {
+        if (order == WO_FIFO)
+            ws.pushBack(w);
+        else
+            ws.push(w);
+    }
+
+    // like detail::suspend with the statistics and the select cases
+    void wait0(Lock& lock, Waiters& ws, Waiter& w)
+    {
+        STATS(
+            std::atomic<uint64_t>& suspended = &ws == &getters ? st.getters : st.putters;
+            ++ suspended;
+            stats::TimePoint started = stats::now();
+        )
+        add0(ws, w);
+        lock.release();
+        deferProceed([this, &w](Handler proceed) {
+            w.setProceed(std::move(proceed));
+            mutex.unlock();
+        });
+        STATS(
+            -- suspended;
+            st.blockedNs += stats::nsSince(started);
+        )
+    }
+
+    // statistics of the value transfers under the mutex
+    void pushed0()
+    {
+        STATS(
+            ++ st.puts;
+            st.depth(queue.size());
+        )
+    }
+
+    void popped0()
+    {
+        STATS(
+            ++ st.gets;
+            st.depth(queue.size());
+        )
+    }
+
+    void handed0()
+    {
+        STATS(
+            ++ st.puts;
+            ++ st.gets;
+        )
+    }
+
+    Waiters getters;
+    Waiters putters;
     mutable std::mutex mutex;
     std::queue<T> queue;
+    size_t capacity;
+    WakeupOrder order;
     bool closed = false;
+    STATS(stats::ChannelStats st;)
+};
+
+namespace detail {
+
+template<typename T, typename T_dst>
+struct SelectGet : SelectCase
+{
+    SelectGet(Channel<T>& c, T_dst& v) : ch(c), dst(v), w(out) {}
+
+    bool enlist(SelectState& s, int index) override
+    {
+        w.select(s, index);
+        return ch.enlistGet0(w);
+    }
+
+    void delist() override
+    {
+        ch.delist0(w);
+    }
+
+    bool ok() const override
+    {
+        return status == CS_EMPTY ? w.hasValue() : status == CS_OK;
+    }
+
+    void complete() override
+    {
+        if (out)
+            dst = std::move(*out);
+    }
+
+    bool poll() override
+    {
+        status = ch.tryGet(dst);
+        return status != CS_EMPTY;
+    }
+
+private:
+    Channel<T>& ch;
+    T_dst& dst;
+    boost::optional<T> out;
+    typename Channel<T>::Waiter w;
+    ChannelStatus status = CS_EMPTY;
+};
+
+template<typename T>
+struct SelectPut : SelectCase
+{
+    SelectPut(Channel<T>& c, T v) : ch(c), val(std::move(v)), w(val) {}
+
+    bool enlist(SelectState& s, int index) override
+    {
+        w.select(s, index);
+        return ch.enlistPut0(w);
+    }
+
+    void delist() override
+    {
+        ch.delist0(w);
+    }
+
+    bool ok() const override
+    {
+        return status == CS_FULL ? w.hasValue() : status == CS_OK;
+    }
+
+    bool poll() override
+    {
+        status = ch.tryPut(std::move(val));
+        return status != CS_FULL;
+    }
+
+private:
+    Channel<T>& ch;
+    T val;
+    typename Channel<T>::Waiter w;
+    ChannelStatus status = CS_FULL;
+};
+
+}
+
+// single producer single consumer channel: the nonblocking path
+// contains only loads, stores and fences, the suspended journey
+// of each side is parked in the single slot
+template<typename T>
+struct Channel<T, Spsc> : Producers<Channel<T, Spsc>>
+{
+private:
+    struct Parked
+    {
+        Handler proc;
+    };
+
+    typedef std::atomic<Parked*> Slot;
+
+public:
+    struct Iterator
+    {
+        Iterator() = default;
+        Iterator(Channel& c) : ch(&c)            { ++*this; }
+
+        T& operator*()                           { return val; }
+        Iterator& operator++()                   { if (!ch->get(val)) ch = nullptr; return *this; }
+        bool operator!=(const Iterator& i) const { return ch != i.ch; }
+    private:
+        T val;
+        Channel* ch = nullptr;
+    };
+
+    explicit Channel(size_t capacity = DEFAULT_RING_CAPACITY) : ring(capacity) {}
+
+    Iterator begin()                             { return {*this}; }
+    static Iterator end()                        { return {}; }
+
+    // suspends the journey while the channel is full,
+    // returns false if the value is not put due to closing
+    bool put(T val)
+    {
+        while (!ring.tryPush(val))
+        {
+            if (closed.load(std::memory_order_acquire))
+                return false;
+            park0(putter, [this] {
+                return !ring.full() || closed.load(std::memory_order_relaxed);
+            });
+        }
+        wake0(getter);
+        return true;
+    }
+
+    bool get(T& val)
+    {
+        while (!ring.tryPop(val))
+        {
+            if (closed.load(std::memory_order_acquire))
+            {
+                // the value may be put before closing
+                if (!ring.tryPop(val))
+                    return false;
+                break;
+            }
+            park0(getter, [this] {
+                return !ring.empty() || closed.load(std::memory_order_relaxed);
+            });
+        }
+        wake0(putter);
+        return true;
+    }
+
+    T get()
+    {
+        T val;
+        get(val);
+        return val;
+    }
+
+    bool empty() const
+    {
+        return ring.empty();
+    }
+
+    // approximate amount of the queued values
+    size_t size() const
+    {
+        return ring.size();
+    }
+
+    void open()
+    {
+        closed = false;
+    }
+
+    void close()
+    {
+        closed = true;
+        wake0(getter);
+        wake0(putter);
+    }
+
+private:
+    // the journey is parked after the suspension, the condition is checked
+    // again to avoid the lost wake up
+    template<typename F_ready>
+    void park0(Slot& slot, F_ready ready)
+    {
+        Parked p;
+        deferProceed([&slot, &p, &ready](Handler proceed) {
+            p.proc = std::move(proceed);
+            slot.store(&p);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (ready())
+                proceed0(slot);
+        });
+    }
+
+    static void wake0(Slot& slot)
+    {
+        // orders the ring modification before the slot check
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (slot.load(std::memory_order_relaxed))
+            proceed0(slot);
+    }
+
+    static void proceed0(Slot& slot)
+    {
+        Parked* p = slot.exchange(nullptr);
+        if (p)
+        {
+            Handler proc = std::move(p->proc);
+            proc();
+        }
+    }
+
+    detail::SpscRing<T> ring;
+    Slot getter{nullptr};
+    Slot putter{nullptr};
+    std::atomic<bool> closed{false};
 };
 
 }
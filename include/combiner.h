@@ -0,0 +1,275 @@
+/*
+ * Copyright 2014 Grigory Demchenko (aka gridem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <exception>
+#include <type_traits>
+#include <boost/optional.hpp>
+
+#include "core.h"
+#include "helpers.h"
+
+namespace synca {
+
+namespace detail {
+
+template<typename R>
+struct CallResult
+{
+    template<typename F>
+    void set(F& f)              { value = f(); }
+    R get()                     { return std::move(*value); }
+
+private:
+    boost::optional<R> value;
+};
+
+template<>
+struct CallResult<void>
+{
+    template<typename F>
+    void set(F& f)              { f(); }
+    void get()                  {}
+};
+
+template<typename T, typename K>
+struct HasBatchGet
+{
+    template<typename U>
+    static auto check(int) -> decltype(
+        std::declval<U&>().batchGet(std::declval<const std::vector<K>&>()), std::true_type());
+    template<typename U>
+    static std::false_type check(...);
+
+    static const bool value = decltype(check<T>(0))::value;
+};
+
+}
+
+// flat combining portal: pending calls are collected as records
+// and the whole batch is executed inside the scheduler at once,
+// the callers don't teleport, methods must not suspend
+template<typename T>
+struct CombiningPortal : Scheduler
+{
+    // invokes the method inside the attached scheduler
+    template<typename T_method, typename... V>
+    auto call(T_method method, V&&... v)
+        -> decltype(std::bind(method, &single<T>(), std::forward<V>(v)...)())
+    {
+        auto f = std::bind(method, &single<T>(), std::forward<V>(v)...);
+        CallRecord<decltype(f)> r(f);
+        submit0(r);
+        return r.result.get();
+    }
+
+    // invokes T::get(key), the keys of the batch are combined
+    // into single T::batchGet(keys) call if T provides it
+    template<typename K>
+    auto get(const K& key) -> typename std::decay<decltype(single<T>().get(key))>::type
+    {
+        typedef typename std::decay<decltype(single<T>().get(key))>::type Result;
+        GetRecord<K, Result> r(key);
+        submit0(r);
+        return std::move(*r.result);
+    }
+
+private:
+    struct Record;
+    typedef void (*BatchHandler)(T&, std::vector<Record*>&);
+
+    struct Record
+    {
+        virtual void run(T& t) = 0;
+
+        Record* next = nullptr;
+        BatchHandler batch = nullptr;
+        Handler proceed;
+        std::exception_ptr exc;
+
+    protected:
+        ~Record() {}
+    };
+
+    template<typename F>
+    struct CallRecord : Record
+    {
+        typedef decltype(std::declval<F&>()()) Result;
+
+        CallRecord(F& f_) : f(f_) {}
+        void run(T&)            { result.set(f); }
+
+        F& f;
+        detail::CallResult<Result> result;
+    };
+
+    template<typename K, typename R>
+    struct GetRecord : Record
+    {
+        GetRecord(const K& k) : key(k)
+        {
+            if (detail::HasBatchGet<T, K>::value)
+                this->batch = &runBatch<K, R>;
+        }
+
+        void run(T& t)          { result = t.get(key); }
+
+        const K& key;
+        boost::optional<R> result;
+    };
+
+    template<typename K, typename R>
+    static void runBatch(T& t, std::vector<Record*>& rs)
+    {
+        batch0<K, R>(t, rs, std::integral_constant<bool, detail::HasBatchGet<T, K>::value>());
+    }
+
+    template<typename K, typename R>
+    static void batch0(T& t, std::vector<Record*>& rs, std::true_type)
+    {
+        std::vector<K> keys;
+        keys.reserve(rs.size());
+        for (Record* r: rs)
+            keys.push_back(static_cast<GetRecord<K, R>*>(r)->key);
+        auto&& values = t.batchGet(keys);
+        VERIFY(values.size() == rs.size(), "batchGet must return value for each key");
+        for (size_t i = 0; i < rs.size(); ++ i)
+            static_cast<GetRecord<K, R>*>(rs[i])->result = std::move(values[i]);
+    }
+
+    template<typename K, typename R>
+    static void batch0(T&, std::vector<Record*>&, std::false_type)
+    {
+    }
+
+    void submit0(Record& r)
+    {
+        deferProceed([this, &r](Handler proceed) {
+            r.proceed = std::move(proceed);
+            Record* h = head.load();
+            do
+            {
+                r.next = h;
+            }
+            while (!head.compare_exchange_weak(h, &r));
+            if (!combining.exchange(true))
+                schedule0();
+        });
+        if (r.exc != std::exception_ptr())
+            std::rethrow_exception(r.exc);
+    }
+
+    void schedule0()
+    {
+        mt::IScheduler& s = *this;
+        s.schedule([this] {
+            drain0();
+        });
+    }
+
+    void drain0()
+    {
+        // limits the rounds to allow other handlers to be executed by the scheduler
+        static const int MAX_ROUNDS = 16;
+
+        for (int round = 0; round < MAX_ROUNDS; ++ round)
+        {
+            Record* r = head.exchange(nullptr);
+            if (r == nullptr)
+            {
+                combining = false;
+                if (head.load() == nullptr || combining.exchange(true))
+                    return;
+                continue;
+            }
+            execute0(reverse0(r));
+        }
+        schedule0();
+    }
+
+    void execute0(Record* rs)
+    {
+        T& t = single<T>();
+        std::vector<std::pair<BatchHandler, std::vector<Record*>>> batches;
+        for (Record* r = rs; r; r = r->next)
+        {
+            if (r->batch)
+            {
+                auto it = batches.begin();
+                while (it != batches.end() && it->first != r->batch)
+                    ++ it;
+                if (it == batches.end())
+                    it = batches.insert(it, {r->batch, {}});
+                it->second.push_back(r);
+                continue;
+            }
+            try
+            {
+                r->run(t);
+            }
+            catch (...)
+            {
+                r->exc = std::current_exception();
+            }
+        }
+        for (auto&& b: batches)
+        {
+            try
+            {
+                b.first(t, b.second);
+            }
+            catch (...)
+            {
+                for (Record* r: b.second)
+                    r->exc = std::current_exception();
+            }
+        }
+        while (rs)
+        {
+            // the record is destroyed by the proceeded journey
+            Handler proceed = std::move(rs->proceed);
+            rs = rs->next;
+            proceed();
+        }
+    }
+
+    static Record* reverse0(Record* r)
+    {
+        Record* result = nullptr;
+        while (r)
+        {
+            Record* next = r->next;
+            r->next = result;
+            result = r;
+            r = next;
+        }
+        return result;
+    }
+
+    std::atomic<Record*> head{nullptr};
+    std::atomic<bool> combining{false};
+};
+
+template<typename T>
+CombiningPortal<T>& combiningPortal()
+{
+    return single<CombiningPortal<T>>();
+}
+
+}
@@ -113,13 +113,17 @@ boost::optional<T_result> goAnyResult(std::initializer_list<std::function<boost:
 struct Alone : mt::IScheduler
 {
     Alone(mt::IService& service, const char* name = "alone");
+    ~Alone();
 
     void schedule(Handler handler);
     const char* name() const;
+    STATS(stats::SchedulerStats* schedulerStats() const override { return st.get(); })
 
 private:
     boost::asio::io_service::strand strand;
     const char* strandName;
+    // shared with the queued handlers which may outlive the scheduler
+    STATS(stats::SchedulerStatsPtr st;)
 };
 
 struct TimeoutTag;
@@ -172,4 +176,38 @@ Scheduler& scheduler()
     return single<Scheduler, T_tag>();
 }
 
+// compile time binding of the tag to the scheduler type,
+// uses static storage without initialization guards and null checks,
+// thus the scheduler must be attached before usage; the scheduling
+// on the bound scheduler still goes through mt::IScheduler
+template<typename T_tag, typename T_scheduler>
+struct Bind
+{
+    typedef T_scheduler SchedulerType;
+
+    static void attach(T_scheduler& s)  { scheduler = &s; }
+    static void detach()                { scheduler = nullptr; }
+    static T_scheduler& get()           { return *scheduler; }
+
+private:
+    static T_scheduler* scheduler;
+};
+
+template<typename T_tag, typename T_scheduler>
+T_scheduler* Bind<T_tag, T_scheduler>::scheduler = nullptr;
+
+// specialized by BIND_SCHEDULER
+template<typename T_tag>
+struct Binding;
+
+template<typename T_tag>
+typename Binding<T_tag>::SchedulerType& bound()
+{
+    return Binding<T_tag>::get();
 }
+
+}
+
+// must be used in the global namespace
+#define BIND_SCHEDULER(D_tag, D_scheduler) \
+    namespace synca { template<> struct Binding<D_tag> : Bind<D_tag, D_scheduler> {}; }
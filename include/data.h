@@ -14,8 +14,22 @@
  * limitations under the License.
  */
 
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <type_traits>
+#include <unordered_map>
+#include <boost/optional.hpp>
+
 #include "mt.h"
 #include "channel.h"
+#include "adaptive.h"
+#include "stats.h"
 #include "helpers.h"
 
 namespace synca {
@@ -44,21 +58,87 @@ Closer<T> closer(T& t)
     return {t};
 }
 
+// releases the producer registered by addProducer
+template<typename T>
+struct Producer
+{
+    Producer(T& t_) : t(t_) {}
+    ~Producer()           { t.releaseProducer(); }
+private:
+    T& t;
+};
+
+template<typename T>
+Producer<T> producer(T& t)
+{
+    return {t};
+}
+
+// the destination is closed after all n journeys are completed
 template<typename T_src, typename T_dst, typename F_pipe>
 void piping(T_src& s, T_dst& d, F_pipe f, int n = 1)
 {
+    d.addProducer(n);
     goN(n, [&s, &d, f] {
-        auto c = closer(d);
+        auto p = producer(d);
         f(s, d);
     });
 }
 
+namespace detail {
+
+// samples the backlog of the profiled stage if the source provides size()
+template<typename T_src>
+auto sizeOf(T_src& s, int) -> decltype(uint64_t(s.size()), std::function<uint64_t()>())
+{
+    return [&s] { return uint64_t(s.size()); };
+}
+
+template<typename T_src>
+std::function<uint64_t()> sizeOf(T_src&, long)
+{
+    return nullptr;
+}
+
+// the subscription is connected to the publishing stage by its broadcast channel
+template<typename T_src>
+auto identityOf(T_src& s, int) -> decltype(static_cast<const void*>(&s.channel()))
+{
+    return &s.channel();
+}
+
+template<typename T_src>
+const void* identityOf(T_src& s, long)
+{
+    return &s;
+}
+
+// the amount of the values which the single consumer takes without the suspension:
+// the size of the source if it is available, otherwise 1 while it is not empty
+template<typename T_src>
+auto backlogOf(T_src& s, int) -> decltype(size_t(s.size()))
+{
+    return s.size();
+}
+
+template<typename T_src>
+size_t backlogOf(T_src& s, long)
+{
+    return s.empty() ? 0 : 1;
+}
+
+}
+
+// the named stages are profiled if flagSTATS is defined, see stats::stages();
+// the output time of piping1toMany is included into the busy time
 template<typename T_src, typename T_dst, typename F_pipe>
-void piping1toMany(T_src& s, T_dst& d, F_pipe f, int n = 1)
+void piping1toMany(T_src& s, T_dst& d, F_pipe f, int n = 1, const char* name = nullptr)
 {
-    piping(s, d, [f] (T_src& s, T_dst& d) {
+    piping(s, d, [f, name] (T_src& s, T_dst& d) {
+        STATS(stats::StageProbe probe(name, detail::identityOf(s, 0), &d, detail::sizeOf(s, 0));)
         for (auto&& v: s)
         {
+            STATS(probe.input();)
             try
             {
                 f(v, d);
@@ -66,47 +146,480 @@ void piping1toMany(T_src& s, T_dst& d, F_pipe f, int n = 1)
             catch (std::exception& e)
             {
                 RJLOG("Error: " << e.what());
+                STATS(probe.error();)
             }
+            STATS(probe.busy();)
         }
     }, n);
 }
 
 template<typename T_src, typename T_dst, typename F_pipe>
-void piping1to1(T_src& s, T_dst& d, F_pipe f, int n = 1)
+void piping1to1(T_src& s, T_dst& d, F_pipe f, int n = 1, const char* name = nullptr)
 {
-    piping(s, d, [f] (T_src& s, T_dst& d) {
+    piping(s, d, [f, name] (T_src& s, T_dst& d) {
+        STATS(stats::StageProbe probe(name, detail::identityOf(s, 0), &d, detail::sizeOf(s, 0));)
         for (auto&& v: s)
         {
+            STATS(probe.input();)
             try
             {
-                d.put(std::move(f(v)));
+                auto&& r = f(v);
+                STATS(probe.busy();)
+                d.put(std::forward<decltype(r)>(r));
+                STATS(probe.output();)
             }
             catch (std::exception& e)
             {
                 RJLOG("Error: " << e.what());
+                STATS(probe.error(); probe.busy();)
             }
         }
     }, n);
 }
 
 template<typename T_src, typename T_dst, typename F_pipe>
-void piping1to01(T_src& s, T_dst& d, F_pipe f, int n = 1)
+void piping1to01(T_src& s, T_dst& d, F_pipe f, int n = 1, const char* name = nullptr)
 {
-    piping(s, d, [f] (T_src& s, T_dst& d) {
+    piping(s, d, [f, name] (T_src& s, T_dst& d) {
+        STATS(stats::StageProbe probe(name, detail::identityOf(s, 0), &d, detail::sizeOf(s, 0));)
         for (auto&& v: s)
         {
+            STATS(probe.input();)
             try
             {
                 auto&& r = f(v);
+                STATS(probe.busy();)
                 if (!isEmpty(r))
+                {
                     d.put(std::move(r));
+                    STATS(probe.output();)
+                }
             }
             catch (std::exception& e)
             {
                 RJLOG("Error: " << e.what());
+                STATS(probe.error(); probe.busy();)
             }
         }
     }, n);
 }
 
-}}
\ No newline at end of file
+// values processed by the single call of the batched stage
+const size_t DEFAULT_BATCH_SIZE = 256;
+
+// like piping but f(std::vector<In>& batch, std::vector<Out>& results) processes up to
+// maxBatch values: the values are taken by the single channel operation waiting at most
+// waitUs microseconds for the batch to be filled and the results are put by putMany,
+// the failed batch is logged and skipped
+template<typename T_src, typename T_dst, typename F_pipe>
+void pipingBatched(T_src& s, T_dst& d, F_pipe f, int n = 1,
+    size_t maxBatch = DEFAULT_BATCH_SIZE, int waitUs = 0, const char* name = nullptr)
+{
+    typedef typename std::decay<decltype(*s.begin())>::type V;
+    typedef typename std::decay<decltype(*d.begin())>::type R;
+
+    piping(s, d, [f, maxBatch, waitUs, name] (T_src& s, T_dst& d) {
+        STATS(stats::StageProbe probe(name, detail::identityOf(s, 0), &d, detail::sizeOf(s, 0));)
+        std::vector<V> batch;
+        std::vector<R> results;
+        while (s.getManyFor(batch, maxBatch, waitUs))
+        {
+            STATS(probe.input(batch.size());)
+            try
+            {
+                f(batch, results);
+                STATS(probe.busy();)
+                d.putMany(std::move(results));
+                STATS(probe.output(results.size());)
+            }
+            catch (std::exception& e)
+            {
+                RJLOG("Error: " << e.what());
+                STATS(probe.error(); probe.busy();)
+            }
+            batch.clear();
+            results.clear();
+        }
+    }, n);
+}
+
+// like piping1toMany but the amount of the workers is changed by the controller
+// within the bounds of the adaptive state, the controller journey ticks using
+// the timeout service and requires size() of the source; the idle workers wait
+// for the source by getFor() to be retired while the source is empty
+template<typename T_src, typename T_dst, typename F_pipe>
+void pipingAdaptive(T_src& s, T_dst& d, F_pipe f, Adaptive& a, const char* name = nullptr)
+{
+    typedef typename std::decay<decltype(*s.begin())>::type V;
+
+    // closed by the last worker to stop the controller
+    auto stop = std::make_shared<Channel<int>>();
+    auto worker = [&s, &d, &a, f, stop, name]() mutable {
+        // the worker retired on the closing of the source may be the last one
+        RetireStatus r = RS_KEEP;
+        {
+            auto p = producer(d);
+            STATS(stats::StageProbe probe(name, detail::identityOf(s, 0), &d, detail::sizeOf(s, 0));)
+            V v;
+            for (ChannelStatus st; (st = s.getFor(v, a.tickMs)) != CS_CLOSED;)
+            {
+                if (st == CS_TIMEDOUT)
+                {
+                    if ((r = a.retire()) != RS_KEEP)
+                        break;
+                    continue;
+                }
+                STATS(probe.input();)
+                auto start = stats::now();
+                try
+                {
+                    f(v, d);
+                }
+                catch (std::exception& e)
+                {
+                    RJLOG("Error: " << e.what());
+                    STATS(probe.error();)
+                }
+                STATS(probe.busy();)
+                a.processed(stats::nsSince(start));
+                if ((r = a.retire()) != RS_KEEP)
+                    break;
+            }
+        }
+        if (r == RS_KEEP ? a.leave() : r == RS_LAST)
+            stop->close();
+    };
+    a.start();
+    // the controller holds the destination while it may spawn the workers
+    d.addProducer(a.minWorkers + 1);
+    for (int i = 0; i < a.minWorkers; ++ i)
+        go(worker);
+    go([&s, &d, &a, worker, stop] {
+        auto p = producer(d);
+        int v;
+        while (stop->getFor(v, a.tickMs) == CS_TIMEDOUT)
+        {
+            int spawn = a.decide(s.size());
+            for (int i = 0; i < spawn && a.enter(); ++ i)
+            {
+                d.addProducer();
+                go(worker);
+            }
+        }
+    });
+}
+
+// results which may wait for the predecessors per worker
+const size_t DEFAULT_REORDER_WINDOW_PER_WORKER = 16;
+
+namespace detail {
+
+// releases the results in the order of the sequence numbers, the tokens limit
+// the amount of the values between the dispatching and the releasing
+template<typename T>
+struct ReorderBuffer
+{
+    explicit ReorderBuffer(size_t window) : tokens(window), slots(window)
+    {
+        for (size_t i = 0; i < window; ++ i)
+            tokens.put(0);
+    }
+
+    // the failed value has no result, the releasing is performed
+    // by the single journey without holding the mutex, output()
+    // is called for each result put by the journey
+    template<typename T_dst, typename F_output>
+    void complete(uint64_t seq, boost::optional<T> result, T_dst& d, F_output output)
+    {
+        Lock lock(mutex);
+        Slot& s = slots[seq % slots.size()];
+        s.done = true;
+        s.result = std::move(result);
+        if (releasing)
+            return;
+        releasing = true;
+        while (true)
+        {
+            Slot& n = slots[next % slots.size()];
+            if (!n.done)
+            {
+                releasing = false;
+                return;
+            }
+            boost::optional<T> r = std::move(n.result);
+            n.done = false;
+            n.result = boost::none;
+            ++ next;
+            lock.unlock();
+            if (r)
+            {
+                d.put(std::move(*r));
+                output();
+            }
+            tokens.put(0);
+            lock.lock();
+        }
+    }
+
+    Channel<int> tokens;
+
+private:
+    typedef std::unique_lock<std::mutex> Lock;
+
+    struct Slot
+    {
+        bool done = false;
+        boost::optional<T> result;
+    };
+
+    std::mutex mutex;
+    std::vector<Slot> slots;
+    uint64_t next = 0;
+    bool releasing = false;
+};
+
+}
+
+// like piping1to1 but the results are put in the order of the source values,
+// the window bounds the results waiting for the slow predecessors
+template<typename T_src, typename T_dst, typename F_pipe>
+void piping1to1Ordered(T_src& s, T_dst& d, F_pipe f, int n, size_t window = 0, const char* name = nullptr)
+{
+    typedef typename std::decay<decltype(*s.begin())>::type V;
+    typedef typename std::decay<typename std::result_of<F_pipe&(V&)>::type>::type R;
+    typedef std::pair<uint64_t, V> Item;
+
+    if (window == 0)
+        window = DEFAULT_REORDER_WINDOW_PER_WORKER * n;
+    auto rb = std::make_shared<detail::ReorderBuffer<R>>(window);
+    auto work = std::make_shared<Channel<Item>>();
+    go([&s, rb, work] {
+        auto c = closer(*work);
+        uint64_t seq = 0;
+        for (auto&& v: s)
+        {
+            rb->tokens.get();
+            work->put(Item(seq ++, std::move(v)));
+        }
+    });
+    d.addProducer(n);
+    goN(n, [&s, &d, f, rb, work, name] {
+        auto p = producer(d);
+        // the backlog is the amount of the dispatched values
+        STATS(stats::StageProbe probe(name, detail::identityOf(s, 0), &d, detail::sizeOf(*work, 0));)
+        for (auto&& item: *work)
+        {
+            STATS(probe.input();)
+            boost::optional<R> r;
+            try
+            {
+                r = f(item.second);
+            }
+            catch (std::exception& e)
+            {
+                RJLOG("Error: " << e.what());
+                STATS(probe.error();)
+            }
+            STATS(probe.busy();)
+            // the results of the other workers may be released here
+            rb->complete(item.first, std::move(r), d, [&] {
+                STATS(probe.output();)
+            });
+        }
+    });
+}
+
+// values collected per partition before putting them by the single operation
+const size_t DEFAULT_ROUTE_BATCH = 64;
+
+namespace detail {
+
+template<typename T>
+struct Partitions
+{
+    explicit Partitions(int n)
+    {
+        for (int i = 0; i < n; ++ i)
+            channels.emplace_back(new Channel<T>);
+    }
+
+    void close()
+    {
+        for (auto&& c: channels)
+            c->close();
+    }
+
+    std::vector<std::unique_ptr<Channel<T>>> channels;
+};
+
+}
+
+// routes the values by the key hash to n partitions, each partition is processed by
+// its own journey with the private copy of f(partition, d), thus the state of f is not shared
+// and the values with the equal keys are processed by the same copy; the values are batched
+// per partition and the batches are put when full or when the source becomes empty
+template<typename T_src, typename T_dst, typename F_key, typename F_pipe>
+void pipingKeyed(T_src& s, T_dst& d, F_key key, F_pipe f, int n, size_t batch = DEFAULT_ROUTE_BATCH,
+    const char* name = nullptr)
+{
+    typedef typename std::decay<decltype(*s.begin())>::type V;
+    typedef typename std::decay<typename std::result_of<F_key&(V&)>::type>::type K;
+
+    auto parts = std::make_shared<detail::Partitions<V>>(n);
+    // the router is profiled, the partitions are processed by f
+    // thus the stage has no destination
+    go([&s, key, parts, batch, name] {
+        auto c = closer(*parts);
+        STATS(stats::StageProbe probe(name, detail::identityOf(s, 0), nullptr, detail::sizeOf(s, 0));)
+        auto& channels = parts->channels;
+        std::vector<std::vector<V>> batches(channels.size());
+        auto flush = [&](size_t i) {
+            STATS(size_t count = batches[i].size();)
+            channels[i]->putMany(std::move(batches[i]));
+            batches[i].clear();
+            STATS(probe.output(count);)
+        };
+        // the source is checked again after the values counted in it are taken
+        size_t ready = 0;
+        for (auto&& v: s)
+        {
+            STATS(probe.input();)
+            try
+            {
+                size_t i = std::hash<K>()(key(v)) % channels.size();
+                batches[i].push_back(std::move(v));
+                STATS(probe.busy();)
+                if (batches[i].size() >= batch)
+                    flush(i);
+            }
+            catch (std::exception& e)
+            {
+                RJLOG("Error: " << e.what());
+                STATS(probe.error(); probe.busy();)
+            }
+            if (ready > 0)
+                -- ready;
+            if (ready == 0 && (ready = detail::backlogOf(s, 0)) == 0)
+            {
+                for (size_t i = 0; i < batches.size(); ++ i)
+                    if (!batches[i].empty())
+                        flush(i);
+            }
+        }
+        for (size_t i = 0; i < batches.size(); ++ i)
+            flush(i);
+    });
+    d.addProducer(n);
+    for (int i = 0; i < n; ++ i)
+    {
+        go([&d, f, parts, i]() mutable {
+            auto p = producer(d);
+            f(*parts->channels[i], d);
+        });
+    }
+}
+
+namespace detail {
+
+// partial maps of each worker are split into the shards by the key hash
+// thus the merging of the different shards is independent
+template<typename T_map>
+struct Reduction
+{
+    typedef typename T_map::key_type Key;
+
+    explicit Reduction(int n_) : n(n_), partials(n_, std::vector<T_map>(n_)) {}
+
+    size_t shard(const Key& k) const
+    {
+        return std::hash<Key>()(k) % n;
+    }
+
+    int n;
+    std::vector<std::vector<T_map>> partials;
+    std::atomic<int> workers{0};
+    std::atomic<int> active{0};
+};
+
+template<typename T_map, typename F_combine>
+void combine(T_map& m, typename T_map::key_type&& k, typename T_map::mapped_type&& v, F_combine& f)
+{
+    auto it = m.find(k);
+    if (it == m.end())
+        m.emplace(std::move(k), std::move(v));
+    else
+        it->second = f(it->second, v);
+}
+
+}
+
+// aggregates the values by n workers into the partial maps using combine(acc, value),
+// after the source is closed the shards of the partial maps are merged by n journeys
+// in parallel and the pairs are put to the destination
+template<template<typename...> class T_map = std::unordered_map,
+    typename T_src, typename T_dst, typename F_key, typename F_value, typename F_combine>
+void reduceByKey(T_src& s, T_dst& d, F_key key, F_value value, F_combine combine, int n = 1,
+    const char* name = nullptr)
+{
+    typedef typename std::decay<decltype(*s.begin())>::type V;
+    typedef typename std::decay<typename std::result_of<F_key&(V&)>::type>::type K;
+    typedef typename std::decay<typename std::result_of<F_value&(V&)>::type>::type A;
+    typedef T_map<K, A> Map;
+
+    auto r = std::make_shared<detail::Reduction<Map>>(n);
+    r->active = n;
+    d.addProducer(n);
+    goN(n, [&s, &d, key, value, combine, r, name] {
+        std::vector<Map>& partial = r->partials[r->workers ++];
+        {
+            // the merging is not included
+            STATS(stats::StageProbe probe(name, detail::identityOf(s, 0), &d, detail::sizeOf(s, 0));)
+            for (auto&& v: s)
+            {
+                STATS(probe.input();)
+                try
+                {
+                    K k = key(v);
+                    size_t i = r->shard(k);
+                    detail::combine(partial[i], std::move(k), value(v), combine);
+                }
+                catch (std::exception& e)
+                {
+                    RJLOG("Error: " << e.what());
+                    STATS(probe.error();)
+                }
+                STATS(probe.busy();)
+            }
+        }
+        if (-- r->active != 0)
+            return;
+        // the last worker starts the merging
+        for (int i = 0; i < r->n; ++ i)
+        {
+            go([&d, combine, r, i] {
+                auto p = producer(d);
+                Map m = std::move(r->partials[0][i]);
+                for (int w = 1; w < r->n; ++ w)
+                {
+                    Map& part = r->partials[w][i];
+                    for (auto&& kv: part)
+                        detail::combine(m, K(kv.first), std::move(kv.second), combine);
+                    Map().swap(part);
+                }
+                for (auto&& kv: m)
+                    d.put(std::make_pair(kv.first, std::move(kv.second)));
+            });
+        }
+    });
+}
+
+// counts the equal values
+template<template<typename...> class T_map = std::unordered_map, typename T_src, typename T_dst>
+void countByKey(T_src& s, T_dst& d, int n = 1, const char* name = nullptr)
+{
+    typedef typename std::decay<decltype(*s.begin())>::type V;
+    reduceByKey<T_map>(s, d, [](const V& v) { return v; }, [](const V&) { return size_t(1); },
+        [](size_t a, size_t b) { return a + b; }, n, name);
+}
+
+}}
@@ -0,0 +1,218 @@
+/*
+ * Copyright 2014 Grigory Demchenko (aka gridem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <exception>
+#include <boost/optional.hpp>
+
+#include "core.h"
+#include "helpers.h"
+
+namespace synca {
+
+namespace detail {
+
+struct FutureStateBase
+{
+    typedef std::unique_lock<std::mutex> Lock;
+
+    // suspends the journey until the result is set
+    void wait()
+    {
+        Lock lock(mutex);
+        if (ready)
+            return;
+        VERIFY(proceed == nullptr, "Future supports only single waiter");
+        lock.release();
+        deferProceed([this](Handler p) {
+            proceed = std::move(p);
+            mutex.unlock();
+        });
+    }
+
+    bool isReady() const
+    {
+        Lock lock(mutex);
+        return ready;
+    }
+
+    void fail(std::exception_ptr e)
+    {
+        exc = e;
+        complete();
+    }
+
+    void complete()
+    {
+        Lock lock(mutex);
+        VERIFY(!ready, "Future result is already set");
+        ready = true;
+        Handler p = std::move(proceed);
+        lock.unlock();
+        if (p)
+            p();
+    }
+
+    void rethrow()
+    {
+        if (exc != std::exception_ptr())
+            std::rethrow_exception(exc);
+    }
+
+private:
+    mutable std::mutex mutex;
+    bool ready = false;
+    Handler proceed;
+    std::exception_ptr exc;
+};
+
+template<typename T>
+struct FutureState : FutureStateBase
+{
+    boost::optional<T> value;
+};
+
+template<>
+struct FutureState<void> : FutureStateBase
+{
+};
+
+}
+
+template<typename T>
+struct Promise;
+
+// result of the asynchronous operation,
+// get() suspends the journey until the result is available
+template<typename T>
+struct Future
+{
+    T get()
+    {
+        state->wait();
+        state->rethrow();
+        return std::move(*state->value);
+    }
+
+    bool ready() const
+    {
+        return state->isReady();
+    }
+
+private:
+    friend struct Promise<T>;
+    typedef std::shared_ptr<detail::FutureState<T>> StatePtr;
+
+    Future(StatePtr s) : state(std::move(s)) {}
+
+    StatePtr state;
+};
+
+template<>
+struct Future<void>
+{
+    void get()
+    {
+        state->wait();
+        state->rethrow();
+    }
+
+    bool ready() const
+    {
+        return state->isReady();
+    }
+
+private:
+    friend struct Promise<void>;
+    typedef std::shared_ptr<detail::FutureState<void>> StatePtr;
+
+    Future(StatePtr s) : state(std::move(s)) {}
+
+    StatePtr state;
+};
+
+template<typename T>
+struct Promise
+{
+    Promise() : state(std::make_shared<detail::FutureState<T>>()) {}
+
+    Future<T> future() const    { return {state}; }
+    void fail(std::exception_ptr e) { state->fail(e); }
+
+    void set(T v)
+    {
+        state->value = std::move(v);
+        state->complete();
+    }
+
+private:
+    std::shared_ptr<detail::FutureState<T>> state;
+};
+
+template<>
+struct Promise<void>
+{
+    Promise() : state(std::make_shared<detail::FutureState<void>>()) {}
+
+    Future<void> future() const { return {state}; }
+    void fail(std::exception_ptr e) { state->fail(e); }
+    void set()                  { state->complete(); }
+
+private:
+    std::shared_ptr<detail::FutureState<void>> state;
+};
+
+namespace detail {
+
+template<typename T, typename F>
+void fulfil(Promise<T>& p, F& f)
+{
+    p.set(f());
+}
+
+template<typename F>
+void fulfil(Promise<void>& p, F& f)
+{
+    f();
+    p.set();
+}
+
+}
+
+// executes the handler through the scheduler without journey creation,
+// the handler must not suspend (it runs outside of any journey)
+template<typename F>
+auto goFuture(F f, mt::IScheduler& s) -> Future<decltype(f())>
+{
+    typedef decltype(f()) Result;
+    Promise<Result> p;
+    s.schedule([p, f]() mutable {
+        try
+        {
+            detail::fulfil(p, f);
+        }
+        catch (...)
+        {
+            p.fail(std::current_exception());
+        }
+    });
+    return p.future();
+}
+
+}
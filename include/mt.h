@@ -22,6 +22,7 @@
 #include <condition_variable>
 
 #include "common.h"
+#include "stats.h"
 
 // thread log: outside coro
 #define  TLOG(D_msg)             LOG(mt::name() << "#" << mt::number() << ": " << D_msg)
@@ -39,6 +40,11 @@ struct IScheduler : IObject
 {
     virtual void schedule(Handler handler) = 0;
     virtual const char* name() const { return "<unknown>"; }
+
+    STATS(
+        // statistics of the registered scheduler, nullptr otherwise
+        virtual stats::SchedulerStats* schedulerStats() const { return nullptr; }
+    )
 };
 
 typedef boost::asio::io_service IoService;
@@ -55,11 +61,13 @@ struct ThreadPool : IScheduler, IService
     void schedule(Handler handler);
     void wait();
     const char* name() const;
+    STATS(stats::SchedulerStats* schedulerStats() const override { return st.get(); })
     
 private:
     IoService& ioService();
 
     const char* tpName;
+    STATS(stats::SchedulerStatsPtr st;)
     std::unique_ptr<boost::asio::io_service::work> work;
     boost::asio::io_service service;
     std::vector<std::thread> threads;
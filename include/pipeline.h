@@ -0,0 +1,493 @@
+/*
+ * Copyright 2014 Grigory Demchenko (aka gridem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <type_traits>
+
+#include "data.h"
+
+// pipeline builder: from(src) | filter(f) | map(g) | flatMap<T>(h).parallel(n) | to(dst)
+// the sequential stages are fused into the single journey loop without the channels,
+// the parallel stage runs in its own journeys and is connected by the channels
+namespace synca {
+namespace data {
+
+// output of the flatMap function
+template<typename T>
+struct Emitter
+{
+    virtual void put(T val) = 0;
+
+protected:
+    ~Emitter() = default;
+};
+
+namespace detail {
+
+template<typename T_src>
+struct SourceValue
+{
+    typedef typename std::decay<decltype(*std::declval<T_src&>().begin())>::type type;
+};
+
+// the operators pass the results to the downstream callable d
+struct PassOp
+{
+    template<typename T_in>
+    struct Out { typedef T_in type; };
+
+    template<typename V, typename D>
+    void operator()(V&& v, D& d)
+    {
+        d(std::forward<V>(v));
+    }
+};
+
+template<typename F>
+struct MapOp
+{
+    template<typename T_in>
+    struct Out { typedef typename std::decay<typename std::result_of<F&(T_in&)>::type>::type type; };
+
+    template<typename V, typename D>
+    void operator()(V&& v, D& d)
+    {
+        d(f(v));
+    }
+
+    F f;
+};
+
+// skips the empty results like piping1to01
+template<typename F>
+struct Map01Op
+{
+    template<typename T_in>
+    struct Out { typedef typename std::decay<typename std::result_of<F&(T_in&)>::type>::type type; };
+
+    template<typename V, typename D>
+    void operator()(V&& v, D& d)
+    {
+        auto&& r = f(v);
+        if (!isEmpty(r))
+            d(std::move(r));
+    }
+
+    F f;
+};
+
+template<typename F>
+struct FilterOp
+{
+    template<typename T_in>
+    struct Out { typedef T_in type; };
+
+    template<typename V, typename D>
+    void operator()(V&& v, D& d)
+    {
+        if (f(v))
+            d(std::forward<V>(v));
+    }
+
+    F f;
+};
+
+template<typename T, typename F>
+struct FlatMapOp
+{
+    template<typename T_in>
+    struct Out { typedef T type; };
+
+    template<typename D>
+    struct Emit : Emitter<T>
+    {
+        explicit Emit(D& d_) : d(d_) {}
+
+        void put(T val) override
+        {
+            d(std::move(val));
+        }
+
+    private:
+        D& d;
+    };
+
+    template<typename V, typename D>
+    void operator()(V&& v, D& d)
+    {
+        Emit<D> e(d);
+        f(v, e);
+    }
+
+    F f;
+};
+
+template<typename T_op, typename D>
+struct Next
+{
+    template<typename V>
+    void operator()(V&& v)
+    {
+        op(std::forward<V>(v), d);
+    }
+
+    T_op& op;
+    D& d;
+};
+
+// fusion of the adjacent operators
+template<typename T_prev, typename T_op>
+struct ComposeOp
+{
+    template<typename T_in>
+    struct Out { typedef typename T_op::template Out<typename T_prev::template Out<T_in>::type>::type type; };
+
+    template<typename V, typename D>
+    void operator()(V&& v, D& d)
+    {
+        Next<T_op, D> next{op, d};
+        prev(std::forward<V>(v), next);
+    }
+
+    T_prev prev;
+    T_op op;
+};
+
+template<typename T_dst>
+struct PutTo
+{
+    template<typename V>
+    void operator()(V&& v)
+    {
+        dst.put(std::forward<V>(v));
+    }
+
+    T_dst& dst;
+};
+
+template<typename F>
+struct CallTo
+{
+    // the consumer can modify the value
+    template<typename V>
+    void operator()(V&& v)
+    {
+        f(v);
+    }
+
+    F f;
+};
+
+// applies the operators in the workers of the adaptive stage
+template<typename T_op, typename T_dst>
+struct AdaptiveCall
+{
+    template<typename V>
+    void operator()(V& v, T_dst& d)
+    {
+        PutTo<T_dst> out{d};
+        op(std::move(v), out);
+    }
+
+    std::shared_ptr<void> keep;
+    T_op op;
+};
+
+// runs n journeys applying the fused operators to each value of the source,
+// keep holds the intermediate channels until the journeys are completed,
+// the named loop is profiled with the output time included into the busy time
+template<typename T_src, typename T_chain, typename T_out>
+void run(std::shared_ptr<void> keep, T_src& s, T_chain chain, T_out out, int n, Handler release,
+    const char* name, const void* dst)
+{
+    goN(n, [keep, &s, chain, out, release, name, dst]() mutable {
+        struct Release
+        {
+            ~Release()  { if (h) h(); }
+            Handler& h;
+        } r{release};
+        STATS(stats::StageProbe probe(name, identityOf(s, 0), dst, sizeOf(s, 0));)
+        for (auto&& v: s)
+        {
+            STATS(probe.input();)
+            try
+            {
+                chain(std::move(v), out);
+            }
+            catch (std::exception& e)
+            {
+                RJLOG("Error: " << e.what());
+                STATS(probe.error();)
+            }
+            STATS(probe.busy();)
+        }
+    });
+}
+
+}
+
+template<typename T_src, typename T_chain>
+struct Flow
+{
+    typedef typename detail::SourceValue<T_src>::type In;
+    typedef typename T_chain::template Out<In>::type Out;
+
+    std::shared_ptr<void> keep;
+    T_src* src;
+    T_chain chain;
+};
+
+// the parallel stage waiting for the destination
+template<typename T_src, typename T_op>
+struct ParallelFlow
+{
+    typedef typename detail::SourceValue<T_src>::type In;
+    typedef typename T_op::template Out<In>::type Out;
+
+    std::shared_ptr<void> keep;
+    T_src* src;
+    T_op op;
+    int n;
+    const char* name;
+};
+
+// the adaptive stage waiting for the destination
+template<typename T_src, typename T_op>
+struct AdaptiveFlow
+{
+    typedef typename detail::SourceValue<T_src>::type In;
+    typedef typename T_op::template Out<In>::type Out;
+
+    std::shared_ptr<void> keep;
+    T_src* src;
+    T_op op;
+    Adaptive* adaptive;
+    const char* name;
+};
+
+template<typename T_op>
+struct ParallelStage
+{
+    T_op op;
+    int n;
+    const char* name;
+};
+
+template<typename T_op>
+struct AdaptiveStage
+{
+    T_op op;
+    Adaptive* adaptive;
+    const char* name;
+};
+
+// the name of the stage is used by the profiler
+template<typename T_op>
+struct Stage
+{
+    ParallelStage<T_op> parallel(int n, const char* name = nullptr) const
+    {
+        return {op, n, name};
+    }
+
+    // the amount of the journeys is changed by the controller, see pipingAdaptive
+    AdaptiveStage<T_op> adaptive(Adaptive& a, const char* name = nullptr) const
+    {
+        return {op, &a, name};
+    }
+
+    T_op op;
+};
+
+template<typename T_dst>
+struct To
+{
+    T_dst& dst;
+    const char* name;
+};
+
+template<typename F>
+struct Sink
+{
+    F f;
+    const char* name;
+};
+
+template<typename T_src>
+Flow<T_src, detail::PassOp> from(T_src& s)
+{
+    return {nullptr, &s, {}};
+}
+
+template<typename F>
+Stage<detail::MapOp<F>> map(F f)
+{
+    return {{f}};
+}
+
+template<typename F>
+Stage<detail::Map01Op<F>> map01(F f)
+{
+    return {{f}};
+}
+
+template<typename F>
+Stage<detail::FilterOp<F>> filter(F f)
+{
+    return {{f}};
+}
+
+// f(const T_in&, Emitter<T>&) puts any amount of the values
+template<typename T, typename F>
+Stage<detail::FlatMapOp<T, F>> flatMap(F f)
+{
+    return {{f}};
+}
+
+// the destination is closed after the last journey of the stage is completed,
+// the name is given to the fused sequential stages
+template<typename T_dst>
+To<T_dst> to(T_dst& dst, const char* name = nullptr)
+{
+    return {dst, name};
+}
+
+// consumes the values within the fused loop
+template<typename F>
+Sink<F> sink(F f, const char* name = nullptr)
+{
+    return {f, name};
+}
+
+template<typename T_src, typename T_chain, typename T_dst>
+void operator|(Flow<T_src, T_chain> f, To<T_dst> t)
+{
+    T_dst& dst = t.dst;
+    dst.addProducer();
+    detail::run(f.keep, *f.src, f.chain, detail::PutTo<T_dst>{dst}, 1, [&dst] {
+        dst.releaseProducer();
+    }, t.name, &dst);
+}
+
+template<typename T_src, typename T_chain, typename F>
+void operator|(Flow<T_src, T_chain> f, Sink<F> s)
+{
+    detail::run(f.keep, *f.src, f.chain, detail::CallTo<F>{s.f}, 1, nullptr, s.name, nullptr);
+}
+
+template<typename T_src, typename T_op, typename T_dst>
+void operator|(ParallelFlow<T_src, T_op> f, To<T_dst> t)
+{
+    T_dst& dst = t.dst;
+    dst.addProducer(f.n);
+    detail::run(f.keep, *f.src, f.op, detail::PutTo<T_dst>{dst}, f.n, [&dst] {
+        dst.releaseProducer();
+    }, f.name, &dst);
+}
+
+template<typename T_src, typename T_op, typename T_dst>
+void operator|(AdaptiveFlow<T_src, T_op> f, To<T_dst> t)
+{
+    pipingAdaptive(*f.src, t.dst, detail::AdaptiveCall<T_op, T_dst>{f.keep, f.op}, *f.adaptive, f.name);
+}
+
+namespace detail {
+
+// inserts the channel after the flow
+template<typename T_flow>
+Flow<Channel<typename T_flow::Out>, PassOp> channel(T_flow f)
+{
+    typedef Channel<typename T_flow::Out> Ch;
+    std::shared_ptr<Ch> c = std::make_shared<Ch>();
+    f | to(*c);
+    // the journeys of the flow keep the channel alive
+    return {c, c.get(), {}};
+}
+
+// the parallel stage reads the source directly if there are no fused operators
+template<typename T_src, typename T_chain>
+struct ParallelSource
+{
+    typedef Channel<typename Flow<T_src, T_chain>::Out> type;
+};
+
+template<typename T_src>
+struct ParallelSource<T_src, PassOp>
+{
+    typedef T_src type;
+};
+
+template<typename T_src>
+Flow<T_src, PassOp> parallelSource(Flow<T_src, PassOp> f)
+{
+    return f;
+}
+
+template<typename T_src, typename T_chain>
+Flow<typename ParallelSource<T_src, T_chain>::type, PassOp> parallelSource(Flow<T_src, T_chain> f)
+{
+    return channel(f);
+}
+
+}
+
+// fuses the stages to run them together in the parallel stage:
+// (flatMap<Str>(f) | map(g)).parallel(n)
+template<typename T_prev, typename T_op>
+Stage<detail::ComposeOp<T_prev, T_op>> operator|(Stage<T_prev> p, Stage<T_op> s)
+{
+    return {{p.op, s.op}};
+}
+
+template<typename T_src, typename T_chain, typename T_op>
+Flow<T_src, detail::ComposeOp<T_chain, T_op>> operator|(Flow<T_src, T_chain> f, Stage<T_op> s)
+{
+    return {f.keep, f.src, {f.chain, s.op}};
+}
+
+template<typename T_src, typename T_chain, typename T_op>
+ParallelFlow<typename detail::ParallelSource<T_src, T_chain>::type, T_op>
+    operator|(Flow<T_src, T_chain> f, ParallelStage<T_op> s)
+{
+    auto p = detail::parallelSource(f);
+    return {p.keep, p.src, s.op, s.n, s.name};
+}
+
+template<typename T_src, typename T_chain, typename T_op>
+AdaptiveFlow<typename detail::ParallelSource<T_src, T_chain>::type, T_op>
+    operator|(Flow<T_src, T_chain> f, AdaptiveStage<T_op> s)
+{
+    // the controller watches the backlog of the source
+    auto p = detail::parallelSource(f);
+    return {p.keep, p.src, s.op, s.adaptive, s.name};
+}
+
+template<typename T_src, typename T_op, typename T_stage>
+auto operator|(ParallelFlow<T_src, T_op> f, T_stage s) -> decltype(detail::channel(f) | s)
+{
+    return detail::channel(f) | s;
+}
+
+template<typename T_src, typename T_op, typename T_stage>
+auto operator|(AdaptiveFlow<T_src, T_op> f, T_stage s) -> decltype(detail::channel(f) | s)
+{
+    return detail::channel(f) | s;
+}
+
+}}
@@ -17,6 +17,8 @@
 #pragma once
 
 #include "core.h"
+#include "future.h"
+#include "stats.h"
 
 namespace synca {
 
@@ -27,6 +29,7 @@ struct Portal
     
 private:
     mt::IScheduler& source;
+    STATS(stats::TimePoint arrived;)
 };
 
 template<typename T>
@@ -39,6 +42,15 @@ struct WithPortal : Scheduler
     };
     
     Access operator->()             { return *this; }
+
+    // invokes the method on the portal scheduler without teleporting the caller,
+    // the method must not suspend because it is executed outside of any journey
+    template<typename T_method, typename... V>
+    auto async(T_method method, V&&... v)
+        -> Future<decltype(std::bind(method, &single<T>(), std::forward<V>(v)...)())>
+    {
+        return goFuture(std::bind(method, &single<T>(), std::forward<V>(v)...), *this);
+    }
 };
 
 template<typename T>
@@ -47,4 +59,31 @@ WithPortal<T>& portal()
     return single<WithPortal<T>>();
 }
 
+// portal to the scheduler bound at compile time by BIND_SCHEDULER:
+// saves the lookup of the scheduler, the teleport is the same as for portal()
+template<typename T>
+struct BoundPortal
+{
+    struct Access : Portal
+    {
+        Access() : Portal(bound<T>()) {}
+        T* operator->()             { return &single<T>(); }
+    };
+
+    Access operator->() const       { return {}; }
+
+    template<typename T_method, typename... V>
+    auto async(T_method method, V&&... v) const
+        -> Future<decltype(std::bind(method, &single<T>(), std::forward<V>(v)...)())>
+    {
+        return goFuture(std::bind(method, &single<T>(), std::forward<V>(v)...), bound<T>());
+    }
+};
+
+template<typename T>
+BoundPortal<T> boundPortal()
+{
+    return {};
+}
+
 }
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2014 Grigory Demchenko (aka gridem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "core.h"
+#include "portal.h"
+
+namespace synca {
+
+// epoch based reclamation shared by all rcu portals
+namespace rcu {
+
+// pins the current thread epoch, calls may be nested
+void enter();
+void leave();
+
+// deleter is invoked after all threads leave the current epoch
+void retire(Handler deleter);
+
+// invokes deleters of the retired objects which are not visible anymore
+void reclaim();
+
+}
+
+// readers access the current version on their own thread without teleport,
+// writers teleport to the attached scheduler and publish new version
+template<typename T>
+struct RcuPortal : Scheduler
+{
+    // snapshot must not be kept across asynchronous operations
+    // because the epoch is pinned for the current thread only
+    struct Snapshot
+    {
+        Snapshot(const T* t_) : t(t_)   {}
+        Snapshot(Snapshot&& s) : t(s.t) { s.t = nullptr; }
+        ~Snapshot()                     { if (t) rcu::leave(); }
+
+        const T* operator->() const     { return t; }
+        const T& operator*() const      { return *t; }
+
+    private:
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+
+        const T* t;
+    };
+
+    RcuPortal() : current(new T()) {}
+
+    ~RcuPortal()
+    {
+        delete current.load();
+    }
+
+    Snapshot read() const
+    {
+        rcu::enter();
+        return {current.load()};
+    }
+
+    Snapshot operator->() const         { return read(); }
+
+    // modifies the copy of the current version and publishes it
+    template<typename F>
+    void update(F f)
+    {
+        Portal p(*this);
+        std::unique_ptr<T> t(new T(*current.load()));
+        f(*t);
+        publish0(t.release());
+    }
+
+    void set(T t)
+    {
+        Portal p(*this);
+        publish0(new T(std::move(t)));
+    }
+
+private:
+    void publish0(T* t)
+    {
+        T* old = current.exchange(t);
+        rcu::retire([old] {
+            delete old;
+        });
+    }
+
+    std::atomic<T*> current;
+};
+
+template<typename T>
+RcuPortal<T>& rcuPortal()
+{
+    return single<RcuPortal<T>>();
+}
+
+}
@@ -0,0 +1,407 @@
+/*
+ * Copyright 2014 Grigory Demchenko (aka gridem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include <type_traits>
+
+#include "core.h"
+#include "helpers.h"
+#include "waiters.h"
+
+namespace synca {
+
+const size_t CACHE_LINE_SIZE = 64;
+const size_t DEFAULT_RING_CAPACITY = 1024;
+
+// registration of the producers: the channel is closed
+// when the last registered producer releases it
+template<typename T_channel>
+struct Producers
+{
+    void addProducer(int n = 1)
+    {
+        producers += n;
+    }
+
+    void releaseProducer()
+    {
+        int left = -- producers;
+        VERIFY(left >= 0, "Producer is not registered");
+        if (left == 0)
+            static_cast<T_channel*>(this)->close();
+    }
+
+private:
+    std::atomic<int> producers{0};
+};
+
+namespace detail {
+
+inline size_t roundUpToPowerOf2(size_t v)
+{
+    size_t r = 1;
+    while (r < v)
+        r <<= 1;
+    return r;
+}
+
+// bounded lock-free multi-producer multi-consumer queue (D. Vyukov)
+template<typename T>
+struct MpmcRing
+{
+    explicit MpmcRing(size_t capacity) :
+        mask(roundUpToPowerOf2(capacity) - 1),
+        cells(new Cell[mask + 1])
+    {
+        for (size_t i = 0; i <= mask; ++ i)
+            cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    ~MpmcRing()
+    {
+        T v;
+        while (tryPop(v));
+    }
+
+    // moves the value on success only
+    bool tryPush(T& v)
+    {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        Cell* c;
+        while (true)
+        {
+            c = &cells[pos & mask];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (dif == 0)
+            {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (dif < 0)
+                return false;
+            else
+                pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+        new (&c->data) T(std::move(v));
+        c->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& v)
+    {
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        Cell* c;
+        while (true)
+        {
+            c = &cells[pos & mask];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (dif == 0)
+            {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (dif < 0)
+                return false;
+            else
+                pos = dequeuePos.load(std::memory_order_relaxed);
+        }
+        T* data = reinterpret_cast<T*>(&c->data);
+        v = std::move(*data);
+        data->~T();
+        c->seq.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // approximate amount of elements
+    size_t size() const
+    {
+        size_t e = enqueuePos.load(std::memory_order_relaxed);
+        size_t d = dequeuePos.load(std::memory_order_relaxed);
+        return e > d ? e - d : 0;
+    }
+
+    size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> seq;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type data;
+    };
+
+    const size_t mask;
+    std::unique_ptr<Cell[]> cells;
+    char pad0[CACHE_LINE_SIZE];
+    std::atomic<size_t> enqueuePos{0};
+    char pad1[CACHE_LINE_SIZE];
+    std::atomic<size_t> dequeuePos{0};
+    char pad2[CACHE_LINE_SIZE];
+};
+
+// bounded single-producer single-consumer queue without atomic read-modify-write,
+// each side caches the index of the opposite side to avoid cache line transfers
+template<typename T>
+struct SpscRing
+{
+    explicit SpscRing(size_t capacity) :
+        mask(roundUpToPowerOf2(capacity) - 1),
+        cells(new Cell[mask + 1])
+    {
+    }
+
+    ~SpscRing()
+    {
+        T v;
+        while (tryPop(v));
+    }
+
+    // producer side, moves the value on success only
+    bool tryPush(T& v)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cachedHead > mask)
+        {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (t - cachedHead > mask)
+                return false;
+        }
+        new (&cells[t & mask]) T(std::move(v));
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool full() const
+    {
+        return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire) > mask;
+    }
+
+    // consumer side
+    bool tryPop(T& v)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == cachedTail)
+        {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (h == cachedTail)
+                return false;
+        }
+        T* data = reinterpret_cast<T*>(&cells[h & mask]);
+        v = std::move(*data);
+        data->~T();
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+    }
+
+    // approximate amount of elements
+    size_t size() const
+    {
+        // the head is read first thus it does not exceed the tail
+        size_t h = head.load(std::memory_order_acquire);
+        return tail.load(std::memory_order_acquire) - h;
+    }
+
+private:
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Cell;
+
+    const size_t mask;
+    std::unique_ptr<Cell[]> cells;
+    char pad0[CACHE_LINE_SIZE];
+    // consumer line
+    std::atomic<size_t> head{0};
+    size_t cachedTail = 0;
+    char pad1[CACHE_LINE_SIZE];
+    // producer line
+    std::atomic<size_t> tail{0};
+    size_t cachedHead = 0;
+    char pad2[CACHE_LINE_SIZE];
+};
+
+}
+
+// bounded channel based on lock-free ring,
+// the waiters are touched only if the journey must be suspended
+template<typename T>
+struct RingChannel : Producers<RingChannel<T>>
+{
+private:
+    typedef detail::Waiter<T> Waiter;
+    typedef detail::Waiters<Waiter> Waiters;
+    typedef std::unique_lock<std::mutex> Lock;
+
+public:
+    struct Iterator
+    {
+        Iterator() = default;
+        Iterator(RingChannel& c) : ch(&c)        { ++*this; }
+
+        T& operator*()                           { return val; }
+        Iterator& operator++()                   { if (!ch->get(val)) ch = nullptr; return *this; }
+        bool operator!=(const Iterator& i) const { return ch != i.ch; }
+    private:
+        T val;
+        RingChannel* ch = nullptr;
+    };
+
+    explicit RingChannel(size_t capacity = DEFAULT_RING_CAPACITY) : ring(capacity) {}
+
+    Iterator begin()                             { return {*this}; }
+    static Iterator end()                        { return {}; }
+
+    // suspends the journey while the channel is full,
+    // returns false if the value is not put due to closing
+    bool put(T val)
+    {
+        if (ring.tryPush(val))
+        {
+            notify0(true);
+            return true;
+        }
+        Lock lock(mutex);
+        ++ puttersCount;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (ring.tryPush(val))
+        {
+            -- puttersCount;
+            lock.unlock();
+            notify0(true);
+            return true;
+        }
+        if (closed)
+        {
+            -- puttersCount;
+            return false;
+        }
+        Waiter w(val);
+        detail::suspend(lock, putters, w);
+        return w.val != nullptr;
+    }
+
+    bool get(T& val)
+    {
+        if (ring.tryPop(val))
+        {
+            notify0(false);
+            return true;
+        }
+        Lock lock(mutex);
+        ++ gettersCount;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (ring.tryPop(val))
+        {
+            -- gettersCount;
+            lock.unlock();
+            notify0(false);
+            return true;
+        }
+        if (closed)
+        {
+            -- gettersCount;
+            return false;
+        }
+        Waiter w(val);
+        detail::suspend(lock, getters, w);
+        return w.val != nullptr;
+    }
+
+    T get()
+    {
+        T val;
+        get(val);
+        return val;
+    }
+
+    bool empty() const
+    {
+        return ring.size() == 0;
+    }
+
+    // approximate amount of the queued values
+    size_t size() const
+    {
+        return ring.size();
+    }
+
+    void close()
+    {
+        Lock lock(mutex);
+        if (closed)
+            return;
+        closed = true;
+        Waiters gs = getters.popAll();
+        Waiters ps = putters.popAll();
+        gettersCount = 0;
+        puttersCount = 0;
+        lock.unlock();
+        gs.cancelAll();
+        ps.cancelAll();
+    }
+
+private:
+
+    // transfers the values to/from the suspended journeys after the ring modification,
+    // each transfer modifies the ring thus the opposite side is notified next
+    void notify0(bool toGetters)
+    {
+        while (true)
+        {
+            Waiters& ws = toGetters ? getters : putters;
+            std::atomic<int>& count = toGetters ? gettersCount : puttersCount;
+            // orders the ring modification before the count check
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (count.load(std::memory_order_relaxed) == 0)
+                return;
+            Lock lock(mutex);
+            Waiter* w = ws.pop();
+            if (w == nullptr)
+                return;
+            bool done = toGetters ? ring.tryPop(*w->val) : ring.tryPush(*w->val);
+            if (!done)
+            {
+                ws.push(*w);
+                return;
+            }
+            -- count;
+            lock.unlock();
+            w->proceed();
+            toGetters = !toGetters;
+        }
+    }
+
+    detail::MpmcRing<T> ring;
+    std::atomic<int> gettersCount{0};
+    std::atomic<int> puttersCount{0};
+    std::mutex mutex;
+    Waiters getters;
+    Waiters putters;
+    bool closed = false;
+};
+
+}
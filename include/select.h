@@ -0,0 +1,63 @@
+/*
+ * Copyright 2014 Grigory Demchenko (aka gridem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <vector>
+#include <memory>
+
+#include "channel.h"
+
+namespace synca {
+
+// waits for the first ready case of several channels within the single journey:
+// the waiter of each case is enlisted to its channel, the first claimed case
+// proceeds the journey and the rest are delisted, single use only
+struct Select
+{
+    static const int TIMEDOUT = detail::SelectState::TIMEDOUT;
+
+    // the value is assigned if the case is selected
+    template<typename T>
+    Select& get(Channel<T>& c, T& val)
+    {
+        cases.emplace_back(new detail::SelectGet<T>(c, val));
+        return *this;
+    }
+
+    // the value is put if the case is selected
+    template<typename T>
+    Select& put(Channel<T>& c, T val)
+    {
+        cases.emplace_back(new detail::SelectPut<T>(c, std::move(val)));
+        return *this;
+    }
+
+    Select& timeout(int ms);
+
+    // suspends the journey, returns the index of the selected case or TIMEDOUT
+    int wait();
+
+    // false if the selected channel is closed or timed out
+    bool ok() const;
+
+private:
+    std::vector<std::unique_ptr<detail::SelectCase>> cases;
+    int timeoutMs = -1;
+    int selected = TIMEDOUT;
+};
+
+}
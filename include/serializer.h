@@ -0,0 +1,63 @@
+/*
+ * Copyright 2014 Grigory Demchenko (aka gridem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <type_traits>
+
+#include "helpers.h"
+
+namespace synca {
+
+// must be specialized for the types passed through the byte based channels:
+// appends the value to the buffer and restores the value from the record
+template<typename T, typename T_enable = void>
+struct Serializer;
+
+template<typename T>
+struct Serializer<T, typename std::enable_if<std::is_trivially_copyable<T>::value>::type>
+{
+    static void write(std::string& buf, const T& v)
+    {
+        buf.append(reinterpret_cast<const char*>(&v), sizeof(T));
+    }
+
+    static T read(const char* data, size_t size)
+    {
+        VERIFY(size == sizeof(T), "Invalid record size");
+        T v;
+        std::memcpy(&v, data, sizeof(T));
+        return v;
+    }
+};
+
+template<>
+struct Serializer<std::string>
+{
+    static void write(std::string& buf, const std::string& v)
+    {
+        buf.append(v);
+    }
+
+    static std::string read(const char* data, size_t size)
+    {
+        return std::string(data, size);
+    }
+};
+
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2014 Grigory Demchenko (aka gridem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+// futex based wakeups are available on linux only
+#ifdef __linux__
+
+#include <memory>
+#include <string>
+
+#include "core.h"
+#include "helpers.h"
+#include "ring.h"
+#include "serializer.h"
+
+namespace synca {
+
+const size_t DEFAULT_SHM_SLOT_SIZE = 256;
+
+enum ShmMode
+{
+    SM_CREATE,  // creates the segment replacing the stale one, removes the name on destruction
+    SM_OPEN,    // opens the segment created by another process
+};
+
+namespace detail {
+
+// bounded lock-free ring of the records inside the POSIX shared memory segment,
+// the journeys are parked locally and woken by the watcher thread which sleeps
+// on the futex of the segment while the ring cannot satisfy them
+struct ShmQueue
+{
+    ShmQueue(const std::string& name, ShmMode mode, size_t capacity, size_t slotSize);
+    ~ShmQueue();
+
+    // returns false if the record is not put due to closing
+    bool put(const std::string& record);
+    bool get(std::string& record);
+    bool empty() const;
+    void close();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+}
+
+// channel between the processes on the same host, the values are converted
+// by the serializer and must fit into the slot
+template<typename T, typename T_serializer = Serializer<T>>
+struct ShmChannel : Producers<ShmChannel<T, T_serializer>>
+{
+    struct Iterator
+    {
+        Iterator() = default;
+        Iterator(ShmChannel& c) : ch(&c)         { ++*this; }
+
+        T& operator*()                           { return val; }
+        Iterator& operator++()                   { if (!ch->get(val)) ch = nullptr; return *this; }
+        bool operator!=(const Iterator& i) const { return ch != i.ch; }
+    private:
+        T val;
+        ShmChannel* ch = nullptr;
+    };
+
+    // the capacity and the slot size of the opened segment are taken from the creator
+    ShmChannel(const std::string& name, ShmMode mode, size_t capacity = DEFAULT_RING_CAPACITY,
+            size_t slotSize = DEFAULT_SHM_SLOT_SIZE) :
+        queue(name, mode, capacity, slotSize)
+    {
+    }
+
+    Iterator begin()                             { return {*this}; }
+    static Iterator end()                        { return {}; }
+
+    bool put(const T& val)
+    {
+        std::string record;
+        T_serializer::write(record, val);
+        return queue.put(record);
+    }
+
+    bool get(T& val)
+    {
+        std::string record;
+        if (!queue.get(record))
+            return false;
+        val = T_serializer::read(record.data(), record.size());
+        return true;
+    }
+
+    T get()
+    {
+        T val;
+        get(val);
+        return val;
+    }
+
+    bool empty() const
+    {
+        return queue.empty();
+    }
+
+    // closes the channel for all processes
+    void close()
+    {
+        queue.close();
+    }
+
+private:
+    detail::ShmQueue queue;
+};
+
+}
+
+#endif
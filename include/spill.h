@@ -0,0 +1,248 @@
+/*
+ * Copyright 2014 Grigory Demchenko (aka gridem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <boost/optional.hpp>
+
+#include "core.h"
+#include "helpers.h"
+#include "ring.h"
+#include "serializer.h"
+#include "waiters.h"
+
+namespace synca {
+
+const size_t DEFAULT_SEGMENT_SIZE = 64 * 1024 * 1024;
+
+namespace detail {
+
+struct SegmentPosition
+{
+    uint64_t segment;
+    uint64_t offset;
+};
+
+// append-only log of the records inside the memory mapped segment files
+// named <prefix>.<segment index>, the consumed segments are removed,
+// the non-durable log removes all its segments on destruction
+struct SegmentLog
+{
+    // the durable log resumes from <prefix>.checkpoint if it exists
+    // and removes the consumed segments on the checkpoint only
+    SegmentLog(const std::string& prefix, size_t segmentSize, bool durable);
+    ~SegmentLog();
+
+    void append(const std::string& record);
+    // returns false if the log is empty
+    bool read(std::string& record);
+    bool empty() const;
+
+    // the position after the last read record
+    SegmentPosition position() const;
+    // flushes the segments and stores the position of the first unconsumed record
+    void checkpoint(SegmentPosition consumed);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+}
+
+// unbounded channel with bounded memory: keeps the head and the tail of the queue
+// in memory and spills the middle to the segment log, the durable channel appends
+// all values to the log and can resume draining after restart from the checkpoint
+template<typename T, typename T_serializer = Serializer<T>>
+struct SpillChannel : Producers<SpillChannel<T, T_serializer>>
+{
+private:
+    typedef detail::Waiter<boost::optional<T>> Waiter;
+    typedef detail::Waiters<Waiter> Waiters;
+    typedef std::unique_lock<std::mutex> Lock;
+
+public:
+    struct Iterator
+    {
+        Iterator() = default;
+        Iterator(SpillChannel& c) : ch(&c)       { ++*this; }
+
+        T& operator*()                           { return *val; }
+        Iterator& operator++()                   { val = boost::none; if (!ch->get(val)) ch = nullptr; return *this; }
+        bool operator!=(const Iterator& i) const { return ch != i.ch; }
+    private:
+        boost::optional<T> val;
+        SpillChannel* ch = nullptr;
+    };
+
+    explicit SpillChannel(const std::string& prefix, size_t memCapacity_ = DEFAULT_RING_CAPACITY,
+            bool durable_ = false, size_t segmentSize = DEFAULT_SEGMENT_SIZE) :
+        log(prefix, segmentSize, durable_),
+        consumed(log.position()),
+        memCapacity(memCapacity_),
+        durable(durable_)
+    {
+    }
+
+    Iterator begin()                             { return {*this}; }
+    static Iterator end()                        { return {}; }
+
+    // never suspends the journey, returns false if the channel is closed
+    bool put(T val)
+    {
+        Lock lock(mutex);
+        if (closed)
+            return false;
+        if (durable)
+            append0(val);
+        else if (log.empty() && tail.empty() && head.size() < memCapacity)
+            head.push_back(std::move(val));
+        else
+        {
+            tail.push_back(std::move(val));
+            if (tail.size() >= memCapacity)
+                spill0();
+        }
+        Waiter* w = getters.pop();
+        if (w == nullptr)
+            return true;
+        take0(*w->val);
+        lock.unlock();
+        w->proceed();
+        return true;
+    }
+
+    bool get(boost::optional<T>& val)
+    {
+        Lock lock(mutex);
+        if (take0(val))
+            return true;
+        if (closed)
+            return false;
+        Waiter w(val);
+        detail::suspend(lock, getters, w);
+        return w.val != nullptr;
+    }
+
+    bool get(T& val)
+    {
+        boost::optional<T> v;
+        if (!get(v))
+            return false;
+        val = std::move(*v);
+        return true;
+    }
+
+    T get()
+    {
+        boost::optional<T> v;
+        get(v);
+        return v ? std::move(*v) : T();
+    }
+
+    bool empty() const
+    {
+        Lock lock(mutex);
+        return head.empty() && tail.empty() && log.empty();
+    }
+
+    // stores the position of the first unconsumed value of the durable channel
+    void checkpoint()
+    {
+        Lock lock(mutex);
+        VERIFY(durable, "Checkpoint requires durable channel");
+        log.checkpoint(consumed);
+    }
+
+    void close()
+    {
+        Lock lock(mutex);
+        if (closed)
+            return;
+        closed = true;
+        Waiters ws = getters.popAll();
+        lock.unlock();
+        ws.cancelAll();
+    }
+
+private:
+    bool take0(boost::optional<T>& val)
+    {
+        if (head.empty())
+            refill0();
+        if (head.empty())
+            return false;
+        val.emplace(std::move(head.front()));
+        head.pop_front();
+        if (!loaded.empty())
+        {
+            consumed = loaded.front();
+            loaded.pop_front();
+        }
+        return true;
+    }
+
+    // the log contains the values older than the tail
+    void refill0()
+    {
+        std::string record;
+        while (head.size() < memCapacity && log.read(record))
+        {
+            head.push_back(T_serializer::read(record.data(), record.size()));
+            if (durable)
+                loaded.push_back(log.position());
+        }
+        if (!head.empty())
+            return;
+        for (auto&& v: tail)
+            head.push_back(std::move(v));
+        tail.clear();
+    }
+
+    void spill0()
+    {
+        for (auto&& v: tail)
+            append0(v);
+        tail.clear();
+    }
+
+    void append0(const T& val)
+    {
+        buf.clear();
+        T_serializer::write(buf, val);
+        log.append(buf);
+    }
+
+    detail::SegmentLog log;
+    std::deque<T> head;
+    std::deque<T> tail;
+    // log positions after the head values read from the durable log
+    std::deque<detail::SegmentPosition> loaded;
+    detail::SegmentPosition consumed;
+    std::string buf;
+    Waiters getters;
+    mutable std::mutex mutex;
+    size_t memCapacity;
+    bool durable;
+    bool closed = false;
+};
+
+}
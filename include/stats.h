@@ -0,0 +1,281 @@
+/*
+ * Copyright 2014 Grigory Demchenko (aka gridem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+#include "common.h"
+
+// statistics collection code, compiled out if flagSTATS is not defined
+#ifdef flagSTATS
+#   define STATS(...)               __VA_ARGS__
+#else
+#   define STATS(...)
+#endif
+
+namespace mt {
+
+struct IScheduler;
+
+}
+
+namespace stats {
+
+typedef std::chrono::steady_clock Clock;
+typedef Clock::time_point TimePoint;
+
+inline TimePoint now()
+{
+    return Clock::now();
+}
+
+inline uint64_t nsSince(TimePoint start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now() - start).count();
+}
+
+// log-linear histogram (HDR-like): 16 linear sub-buckets per power of 2
+struct Histogram
+{
+    Histogram();
+
+    void record(uint64_t value);
+    uint64_t count() const;
+
+    // returns the upper bound of the bucket containing the percentile, p in [0, 1]
+    uint64_t percentile(double p) const;
+
+private:
+    static const int SUB_BITS = 4;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    static const int BUCKETS = (64 - SUB_BITS + 1) * SUB_COUNT;
+
+    static int index0(uint64_t value);
+    static uint64_t upper0(int index);
+
+    std::atomic<uint64_t> buckets[BUCKETS];
+};
+
+struct SchedulerStats
+{
+    // time between scheduling and execution of the handler
+    Histogram queueWait;
+    // handler execution time
+    Histogram execution;
+    // time between teleport request and arrival to the scheduler
+    Histogram teleport;
+    // time spent inside the portals to the scheduler
+    Histogram portal;
+    // teleports to the scheduler
+    std::atomic<uint64_t> hops{0};
+};
+
+typedef std::shared_ptr<SchedulerStats> SchedulerStatsPtr;
+
+// the scheduler registers on creation and unregisters on destruction,
+// the returned statistics are kept alive by their holders after the unregistration
+SchedulerStatsPtr registerScheduler(const mt::IScheduler& s);
+void unregisterScheduler(const mt::IScheduler& s);
+
+struct Percentiles
+{
+    uint64_t count;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+};
+
+// latencies are in nanoseconds
+struct SchedulerSnapshot
+{
+    std::string name;
+    uint64_t hops;
+    Percentiles queueWait;
+    Percentiles execution;
+    Percentiles teleport;
+    Percentiles portal;
+};
+
+std::vector<SchedulerSnapshot> snapshot();
+
+struct ChannelStats
+{
+    void depth(uint64_t d);
+
+    // current and max amount of the queued values
+    std::atomic<uint64_t> currentDepth{0};
+    std::atomic<uint64_t> maxDepth{0};
+    std::atomic<uint64_t> puts{0};
+    std::atomic<uint64_t> gets{0};
+    // currently suspended journeys
+    std::atomic<uint64_t> getters{0};
+    std::atomic<uint64_t> putters{0};
+    // cumulative time of the suspended journeys
+    std::atomic<uint64_t> blockedNs{0};
+};
+
+// the named channels are enumerated by the snapshot
+void registerChannel(ChannelStats& s, const char* name);
+void unregisterChannel(ChannelStats& s);
+
+struct ChannelSnapshot
+{
+    std::string name;
+    uint64_t depth;
+    uint64_t maxDepth;
+    uint64_t puts;
+    uint64_t gets;
+    uint64_t getters;
+    uint64_t putters;
+    uint64_t blockedNs;
+};
+
+std::vector<ChannelSnapshot> channels();
+
+struct StageStats
+{
+    std::atomic<uint64_t> in{0};
+    std::atomic<uint64_t> out{0};
+    std::atomic<uint64_t> errors{0};
+    // processing of the values
+    std::atomic<uint64_t> busyNs{0};
+    // waiting for the values of the source
+    std::atomic<uint64_t> inputBlockedNs{0};
+    // putting the results to the destination
+    std::atomic<uint64_t> outputBlockedNs{0};
+    // last sampled amount of the values in the source
+    std::atomic<uint64_t> backlog{0};
+    std::atomic<uint64_t> workers{0};
+};
+
+// the stages with the same name share the statistics, the stages are connected
+// in the graph if the destination of one stage is the source of another one
+StageStats& stage(const char* name, const void* src, const void* dst);
+
+// per journey counters of the stage, the shared statistics are updated by batches;
+// the cycle is input, busy and optional output, the values are counted exactly while
+// the times are measured for each SAMPLE_PERIOD-th cycle only and scaled
+struct StageProbe
+{
+    // disabled if the stage is not named
+    StageProbe(const char* name, const void* src, const void* dst, std::function<uint64_t()> size);
+    ~StageProbe();
+
+    // the values are received from the source
+    void input(uint64_t count = 1)
+    {
+        if (!st)
+            return;
+        in += count;
+        if (sampled)
+            mark0(inputBlockedNs);
+    }
+
+    // the values are processed
+    void busy()
+    {
+        if (!st)
+            return;
+        if (sampled)
+            mark0(busyNs);
+        outputSampled = sampled;
+        sampled = (++ cycles & (SAMPLE_PERIOD - 1)) == 0;
+        if (sampled)
+            last = now();
+        if (in >= FLUSH_COUNT)
+            flush();
+    }
+
+    // the results are put to the destination
+    void output(uint64_t count = 1)
+    {
+        if (!st)
+            return;
+        out += count;
+        if (outputSampled)
+            mark0(outputBlockedNs);
+        else if (sampled)
+            last = now();
+        outputSampled = false;
+    }
+
+    void error()
+    {
+        if (st)
+            ++ errors;
+    }
+
+private:
+    static const uint64_t FLUSH_COUNT = 256;
+    static const uint64_t SAMPLE_PERIOD = 16;
+
+    void mark0(uint64_t& ns)
+    {
+        TimePoint t = now();
+        ns += std::chrono::duration_cast<std::chrono::nanoseconds>(t - last).count() * SAMPLE_PERIOD;
+        last = t;
+    }
+
+    void flush();
+
+    StageStats* st;
+    std::function<uint64_t()> size;
+    TimePoint last;
+    uint64_t cycles = 0;
+    bool sampled = true;
+    bool outputSampled = false;
+    uint64_t in = 0;
+    uint64_t out = 0;
+    uint64_t errors = 0;
+    uint64_t busyNs = 0;
+    uint64_t inputBlockedNs = 0;
+    uint64_t outputBlockedNs = 0;
+};
+
+struct StageSnapshot
+{
+    std::string name;
+    uint64_t in;
+    uint64_t out;
+    uint64_t errors;
+    uint64_t busyNs;
+    uint64_t inputBlockedNs;
+    uint64_t outputBlockedNs;
+    uint64_t backlog;
+    uint64_t workers;
+    const void* src;
+    const void* dst;
+};
+
+std::vector<StageSnapshot> stages();
+
+// the table of the stages, may be printed periodically
+std::string stagesTable();
+
+// the graph of the stages in DOT format, the edges are weighted by the transferred values
+std::string stagesDot();
+
+// outputs the snapshots using release log
+void dump();
+
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2014 Grigory Demchenko (aka gridem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <mutex>
+
+#include "core.h"
+
+namespace synca {
+namespace detail {
+
+// the journey suspended on the value transfer, the value pointer
+// is reset if the transfer is cancelled by closing
+template<typename T>
+struct Waiter
+{
+    explicit Waiter(T& v) : val(&v) {}
+
+    // the handler is moved out: the resumed journey may destroy the waiter
+    void proceed()
+    {
+        Handler p = std::move(proc);
+        p();
+    }
+
+    void cancel()
+    {
+        val = nullptr;
+        proceed();
+    }
+
+    Handler proc;
+    Waiter* next = nullptr;
+    T* val;
+};
+
+// intrusive stack of the waiters protected by the mutex of the owner
+template<typename T_waiter>
+struct Waiters
+{
+    T_waiter* pop()
+    {
+        T_waiter* w = root;
+        if (w)
+            root = w->next;
+        return w;
+    }
+
+    void push(T_waiter& w)
+    {
+        w.next = root;
+        root = &w;
+    }
+
+    bool empty() const
+    {
+        return root == nullptr;
+    }
+
+    Waiters popAll()
+    {
+        Waiters ws = *this;
+        root = nullptr;
+        return ws;
+    }
+
+    void append(Waiters ws)
+    {
+        for (T_waiter* w = ws.pop(); w; w = ws.pop())
+            push(*w);
+    }
+
+    void proceedAll()
+    {
+        for (T_waiter* w = pop(); w; w = pop())
+            w->proceed();
+    }
+
+    void cancelAll()
+    {
+        for (T_waiter* w = pop(); w; w = pop())
+            w->cancel();
+    }
+
+private:
+    T_waiter* root = nullptr;
+};
+
+// pushes the waiter and suspends the journey, the mutex is unlocked after
+// the journey is suspended thus the waker taking the waiter under the mutex
+// always finds its proceed handler; onSuspended is called before the unlock
+// because after it the journey may be resumed and the owner destroyed
+template<typename T_waiter, typename F_suspended>
+void suspend(std::unique_lock<std::mutex>& lock, Waiters<T_waiter>& ws, T_waiter& w, F_suspended onSuspended)
+{
+    ws.push(w);
+    std::mutex& mutex = *lock.release();
+    deferProceed([&mutex, &w, &onSuspended](Handler proceed) {
+        w.proc = std::move(proceed);
+        onSuspended();
+        mutex.unlock();
+    });
+}
+
+template<typename T_waiter>
+void suspend(std::unique_lock<std::mutex>& lock, Waiters<T_waiter>& ws, T_waiter& w)
+{
+    suspend(lock, ws, w, [] {});
+}
+
+}}
@@ -0,0 +1,175 @@
+/*
+ * Copyright 2014 Grigory Demchenko (aka gridem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "adaptive.h"
+#include "core.h"
+#include "helpers.h"
+
+namespace synca {
+namespace data {
+
+// the throughput gain to keep the scale up
+const double MIN_GAIN = 0.1;
+// ticks without the scale up after the rejected one
+const int HOLD_TICKS = 5;
+
+Adaptive::Adaptive(int minWorkers_, int maxWorkers_, int tickMs_) :
+    minWorkers(minWorkers_), maxWorkers(maxWorkers_), tickMs(tickMs_)
+{
+    VERIFY(minWorkers > 0 && minWorkers <= maxWorkers, "Invalid adaptive workers bounds");
+    VERIFY(tickMs > 0, "Invalid adaptive tick");
+}
+
+AdaptiveSnapshot Adaptive::snapshot() const
+{
+    AdaptiveSnapshot s;
+    s.workers = active;
+    s.peakWorkers = peakWorkers;
+    s.depth = lastDepth;
+    s.processed = processedCount;
+    s.throughput = double(throughput);
+    s.latencyNs = latencyNs;
+    s.scaleUps = scaleUps;
+    s.scaleDowns = scaleDowns;
+    s.rejected = rejected;
+    return s;
+}
+
+void Adaptive::start()
+{
+    active = minWorkers;
+    peak(minWorkers);
+    lastTick = stats::now();
+}
+
+void Adaptive::processed(uint64_t ns)
+{
+    busyNs += ns;
+    ++ processedCount;
+}
+
+RetireStatus Adaptive::retire()
+{
+    int e = excess;
+    while (e > 0)
+    {
+        if (excess.compare_exchange_weak(e, e - 1))
+            return -- active == 0 ? RS_LAST : RS_RETIRED;
+    }
+    return RS_KEEP;
+}
+
+bool Adaptive::enter()
+{
+    // the completed stage has no workers
+    int a = active;
+    while (a > 0)
+    {
+        if (active.compare_exchange_weak(a, a + 1))
+        {
+            peak(a + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Adaptive::leave()
+{
+    return -- active == 0;
+}
+
+int Adaptive::decide(size_t depth)
+{
+    stats::TimePoint now = stats::now();
+    double dt = std::chrono::duration<double>(now - lastTick).count();
+    lastTick = now;
+    return decide(depth, dt);
+}
+
+int Adaptive::decide(size_t depth, double dt)
+{
+    uint64_t p = processedCount;
+    uint64_t b = busyNs;
+    uint64_t dp = p - lastProcessed;
+    uint64_t db = b - lastBusy;
+    lastProcessed = p;
+    lastBusy = b;
+    double tput = dp / dt;
+    throughput = uint64_t(tput);
+    if (dp > 0)
+        latencyNs = db / dp;
+    double arrival = std::max(0.0, (dp + double(depth) - double(lastDepth)) / dt);
+    lastDepth = depth;
+
+    int n = active - excess;
+    int delta = 0;
+    if (settle)
+    {
+        // the spawned workers are started during the tick
+        settle = false;
+    }
+    else if (probe > 0)
+    {
+        if (tput < baseThroughput * (1 + MIN_GAIN))
+        {
+            delta = -probe;
+            hold = HOLD_TICKS;
+            ++ rejected;
+        }
+        probe = 0;
+    }
+    else if (hold > 0)
+    {
+        -- hold;
+    }
+    else if (depth > 0 && n < maxWorkers)
+    {
+        // at most doubles the workers per tick
+        int needed = int(std::ceil(arrival * latencyNs * 1e-9));
+        delta = std::min(std::max(needed - n, 1), n);
+        delta = std::min(delta, maxWorkers - n);
+        probe = delta;
+        settle = true;
+        baseThroughput = tput;
+        ++ scaleUps;
+    }
+    else if (depth == 0 && n > minWorkers && db < dt * 1e9 * n / 2)
+    {
+        // less than half of the workers are busy
+        delta = -1;
+        ++ scaleDowns;
+    }
+    if (delta != 0)
+        JLOG("adaptive: workers " << n << ", change " << delta << ", depth " << depth << ", throughput " << tput);
+    if (delta >= 0)
+        return delta;
+    // the excess never retires all the active workers
+    int e = excess;
+    while (!excess.compare_exchange_weak(e, std::max(0, std::min(e - delta, active - 1))));
+    return 0;
+}
+
+void Adaptive::peak(int workers)
+{
+    int p = peakWorkers;
+    while (p < workers && !peakWorkers.compare_exchange_weak(p, workers));
+}
+
+}}
@@ -19,6 +19,7 @@
 #include "core.h"
 #include "journey.h"
 #include "helpers.h"
+#include "stats.h"
 
 namespace synca {
 
@@ -170,10 +171,26 @@ size_t goAnyWait(std::initializer_list<Handler> handlers)
 Alone::Alone(mt::IService& service, const char* name) :
     strand(service.ioService()), strandName(name)
 {
+    STATS(st = stats::registerScheduler(*this);)
+}
+
+Alone::~Alone()
+{
+    STATS(stats::unregisterScheduler(*this);)
 }
 
 void Alone::schedule(Handler handler)
 {
+    STATS(
+        stats::SchedulerStatsPtr s = st;
+        stats::TimePoint scheduled = stats::now();
+        handler = [handler, scheduled, s] {
+            s->queueWait.record(stats::nsSince(scheduled));
+            stats::TimePoint started = stats::now();
+            handler();
+            s->execution.record(stats::nsSince(started));
+        };
+    )
     strand.post(std::move(handler));
 }
 
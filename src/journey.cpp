@@ -19,6 +19,7 @@
 
 #include "journey.h"
 #include "helpers.h"
+#include "stats.h"
 
 namespace synca {
 
@@ -75,7 +76,18 @@ void Journey::teleport(mt::IScheduler& s)
     }
     JLOG("teleport " << sched->name() << " -> " << s.name());
     sched = &s;
+    STATS(
+        // the scheduler may be not registered
+        stats::SchedulerStats* st = s.schedulerStats();
+        if (st)
+            ++ st->hops;
+        stats::TimePoint started = stats::now();
+    )
     defer(proceedHandler());
+    STATS(
+        if (st)
+            st->teleport.record(stats::nsSince(started));
+    )
 }
 
 void Journey::handleEvents()
@@ -15,6 +15,7 @@
  */
 
 #include "mt.h"
+#include "stats.h"
 #include "helpers.h"
 
 // ThreadPool log: inside ThreadPool functionality
@@ -56,6 +57,7 @@ std::thread createThread(Handler handler, int number, const char* name)
 
 ThreadPool::ThreadPool(size_t threadCount, const char* name) : tpName(name)
 {
+    STATS(st = stats::registerScheduler(*this);)
     work.reset(new boost::asio::io_service::work(service));
     threads.reserve(threadCount);
     for (size_t i = 0; i < threadCount; ++ i)
@@ -88,6 +90,7 @@ ThreadPool::~ThreadPool()
     for (size_t i = 0; i < threads.size(); ++ i)
         threads[i].join();
     PLOG("thread pool stopped");
+    STATS(stats::unregisterScheduler(*this);)
 }
 
 void ThreadPool::schedule(Handler handler)
@@ -25,10 +25,16 @@ Portal::Portal(mt::IScheduler& destination) :
 {
     JLOG("creating portal " << source.name() << " <=> " << destination.name());
     teleport(destination);
+    STATS(arrived = stats::now();)
 }
 
 Portal::~Portal()
 {
+    STATS(
+        stats::SchedulerStats* st = journey().scheduler().schedulerStats();
+        if (st)
+            st->portal.record(stats::nsSince(arrived));
+    )
     teleport(source);
 }
 
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2014 Grigory Demchenko (aka gridem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+#include "rcu.h"
+#include "helpers.h"
+
+namespace synca {
+namespace rcu {
+
+const size_t CACHE_LINE = 64;
+
+// the epoch of the thread, 0 means the thread doesn't read anything;
+// the record of the exited thread is reused by the next acquiring thread
+struct ThreadRecord
+{
+    char pad0[CACHE_LINE];
+    std::atomic<uint64_t> epoch{0};
+    int nesting = 0;
+    std::atomic<bool> used{true};
+    ThreadRecord* next = nullptr;
+    char pad1[CACHE_LINE];
+};
+
+struct Domain
+{
+    std::atomic<uint64_t> epoch{1};
+    std::atomic<ThreadRecord*> records{nullptr};
+    std::mutex mutex;
+    std::vector<std::pair<uint64_t, Handler>> retired;
+};
+
+Domain& domain()
+{
+    return single<Domain>();
+}
+
+// the records are never removed from the list thus it may be traversed without the lock
+ThreadRecord* acquireRecord()
+{
+    Domain& d = domain();
+    for (ThreadRecord* r = d.records.load(); r; r = r->next)
+    {
+        bool used = false;
+        if (!r->used.load() && r->used.compare_exchange_strong(used, true))
+            return r;
+    }
+    ThreadRecord* r = new ThreadRecord;
+    r->next = d.records.load();
+    while (!d.records.compare_exchange_weak(r->next, r));
+    return r;
+}
+
+TLS ThreadRecord* t_record = nullptr;
+
+// TLS has no destructors thus the record is released on the thread exit
+// by the thread_local object, its zero epoch doesn't block the reclamation
+struct RecordReleaser
+{
+    ~RecordReleaser()
+    {
+        if (t_record)
+            t_record->used = false;
+    }
+};
+
+ThreadRecord& record()
+{
+    if (t_record == nullptr)
+    {
+        static thread_local RecordReleaser releaser;
+        (void) releaser;
+        t_record = acquireRecord();
+    }
+    return *t_record;
+}
+
+void enter()
+{
+    ThreadRecord& r = record();
+    if (r.nesting ++ == 0)
+        r.epoch = domain().epoch.load();
+}
+
+void leave()
+{
+    ThreadRecord& r = record();
+    if (-- r.nesting == 0)
+        r.epoch.store(0, std::memory_order_release);
+}
+
+void retire(Handler deleter)
+{
+    Domain& d = domain();
+    {
+        std::lock_guard<std::mutex> lock(d.mutex);
+        d.retired.emplace_back(d.epoch.fetch_add(1), std::move(deleter));
+    }
+    reclaim();
+}
+
+void reclaim()
+{
+    Domain& d = domain();
+    uint64_t minEpoch = UINT64_MAX;
+    for (ThreadRecord* r = d.records.load(); r; r = r->next)
+    {
+        uint64_t e = r->epoch.load();
+        if (e != 0 && e < minEpoch)
+            minEpoch = e;
+    }
+    std::vector<Handler> toDelete;
+    {
+        std::lock_guard<std::mutex> lock(d.mutex);
+        size_t kept = 0;
+        for (size_t i = 0; i < d.retired.size(); ++ i)
+        {
+            auto& r = d.retired[i];
+            // readers pinned at the retire epoch or earlier may still use it
+            if (r.first < minEpoch)
+                toDelete.emplace_back(std::move(r.second));
+            else if (kept ++ != i)
+                d.retired[kept - 1] = std::move(r);
+        }
+        d.retired.resize(kept);
+    }
+    for (auto&& deleter: toDelete)
+        deleter();
+}
+
+}}
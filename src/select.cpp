@@ -0,0 +1,110 @@
+/*
+ * Copyright 2014 Grigory Demchenko (aka gridem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "select.h"
+
+namespace synca {
+
+typedef boost::system::error_code Error;
+typedef std::unique_ptr<boost::asio::deadline_timer> TimerPtr;
+
+namespace detail {
+
+// the cases are delisted even if the journey is interrupted by the event
+struct Delister
+{
+    Delister(const std::vector<SelectCase*>& cs) : cases(cs) {}
+    ~Delister()
+    {
+        for (auto c: cases)
+            c->delist();
+    }
+
+private:
+    const std::vector<SelectCase*>& cases;
+};
+
+int waitCases(const std::vector<SelectCase*>& cases, int timeoutMs)
+{
+    return waitCasesUs(cases, timeoutMs < 0 ? -1 : int64_t(timeoutMs) * 1000);
+}
+
+int waitCasesUs(const std::vector<SelectCase*>& cases, int64_t timeoutUs)
+{
+    // the ready case avoids the shared state, the timer and the suspension
+    for (size_t i = 0; i < cases.size(); ++ i)
+    {
+        if (cases[i]->poll())
+        {
+            JLOG("polled: " << i);
+            return static_cast<int>(i);
+        }
+    }
+    // the timer handler may outlive the cases
+    auto state = std::make_shared<SelectState>();
+    TimerPtr timer;
+    {
+        Delister delister(cases);
+        deferProceed([&cases, timeoutUs, &state, &timer](Handler proceed) {
+            state->proc = std::move(proceed);
+            for (size_t i = 0; i < cases.size(); ++ i)
+            {
+                if (!cases[i]->enlist(*state, static_cast<int>(i)))
+                    break;
+            }
+            if (timeoutUs >= 0 && state->fired == SelectState::NONE)
+            {
+                timer.reset(new boost::asio::deadline_timer(
+                    service<TimeoutTag>(), boost::posix_time::microseconds(timeoutUs)));
+                std::shared_ptr<SelectState> s = state;
+                timer->async_wait([s](const Error& error) {
+                    if (!error && s->claim(SelectState::TIMEDOUT))
+                        s->done();
+                });
+            }
+            state->done();
+        });
+    }
+    int selected = state->fired;
+    JLOG("selected: " << selected);
+    if (selected >= 0)
+        cases[selected]->complete();
+    return selected;
+}
+
+}
+
+Select& Select::timeout(int ms)
+{
+    timeoutMs = ms;
+    return *this;
+}
+
+int Select::wait()
+{
+    std::vector<detail::SelectCase*> cs;
+    for (auto&& c: cases)
+        cs.push_back(c.get());
+    selected = detail::waitCases(cs, timeoutMs);
+    return selected;
+}
+
+bool Select::ok() const
+{
+    return selected != TIMEDOUT && cases[selected]->ok();
+}
+
+}
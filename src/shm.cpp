@@ -0,0 +1,449 @@
+/*
+ * Copyright 2014 Grigory Demchenko (aka gridem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shm.h"
+
+#ifdef __linux__
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <climits>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "mt.h"
+#include "waiters.h"
+
+namespace synca {
+namespace detail {
+
+namespace bip = boost::interprocess;
+
+const uint64_t SHM_MAGIC = 0x73796e6361736d31ull; // "syncasm1"
+
+// the futex is shared between the processes thus FUTEX_PRIVATE_FLAG is not used
+void futexWait(std::atomic<uint32_t>& word, uint32_t val)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, val, nullptr, nullptr, 0);
+}
+
+void futexWakeAll(std::atomic<uint32_t>& word)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+// the layout of the segment: header followed by the cells
+struct ShmHeader
+{
+    std::atomic<uint64_t> magic;
+    uint64_t capacity;
+    uint64_t slotSize;
+    char pad0[CACHE_LINE_SIZE];
+    std::atomic<uint64_t> enqueuePos;
+    char pad1[CACHE_LINE_SIZE];
+    std::atomic<uint64_t> dequeuePos;
+    char pad2[CACHE_LINE_SIZE];
+    // futex word: changed on the ring modification if somebody sleeps and on the kick
+    std::atomic<uint32_t> seq;
+    // amount of the watchers sleeping with the parked journeys
+    std::atomic<uint32_t> sleepers;
+    std::atomic<uint32_t> closed;
+    char pad3[CACHE_LINE_SIZE];
+};
+
+// the record of the size is stored right after the cell
+struct ShmCell
+{
+    std::atomic<uint64_t> seq;
+    uint32_t size;
+};
+
+struct ShmWaiter
+{
+    Handler proc;
+    ShmWaiter* next = nullptr;
+    const std::string* in = nullptr;
+    std::string* out = nullptr;
+    bool ok = true;
+};
+
+typedef Waiters<ShmWaiter> ShmWaiters;
+
+typedef std::unique_lock<std::mutex> Lock;
+
+struct ShmQueue::Impl
+{
+    Impl(const std::string& name_, ShmMode mode, size_t capacity, size_t slotSize) :
+        name(name_), owner(mode == SM_CREATE)
+    {
+        if (owner)
+        {
+            bip::shared_memory_object::remove(name.c_str());
+            capacity = roundUpToPowerOf2(capacity);
+            size_t s = stride(slotSize);
+            shm = bip::shared_memory_object(bip::create_only, name.c_str(), bip::read_write);
+            shm.truncate(sizeof(ShmHeader) + capacity * s);
+            region = bip::mapped_region(shm, bip::read_write);
+            init(capacity, slotSize);
+        }
+        else
+        {
+            shm = bip::shared_memory_object(bip::open_only, name.c_str(), bip::read_write);
+            region = bip::mapped_region(shm, bip::read_write);
+            VERIFY(region.get_size() >= sizeof(ShmHeader), "Invalid shared memory segment");
+            attach();
+        }
+    }
+
+    ~Impl()
+    {
+        if (owner)
+            bip::shared_memory_object::remove(name.c_str());
+    }
+
+    static size_t stride(size_t slotSize)
+    {
+        size_t s = sizeof(ShmCell) + slotSize;
+        return (s + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    }
+
+    void init(size_t capacity, size_t slotSize)
+    {
+        h = new (region.get_address()) ShmHeader;
+        h->capacity = capacity;
+        h->slotSize = slotSize;
+        h->enqueuePos.store(0, std::memory_order_relaxed);
+        h->dequeuePos.store(0, std::memory_order_relaxed);
+        h->seq.store(0, std::memory_order_relaxed);
+        h->sleepers.store(0, std::memory_order_relaxed);
+        h->closed.store(0, std::memory_order_relaxed);
+        setup();
+        for (uint64_t i = 0; i <= mask; ++ i)
+        {
+            ShmCell* c = new (&cell(i)) ShmCell;
+            c->seq.store(i, std::memory_order_relaxed);
+            c->size = 0;
+        }
+        // the segment is ready for the other processes
+        h->magic.store(SHM_MAGIC, std::memory_order_release);
+    }
+
+    void attach()
+    {
+        h = static_cast<ShmHeader*>(region.get_address());
+        VERIFY(h->magic.load(std::memory_order_acquire) == SHM_MAGIC, "Shared memory segment is not initialized");
+        setup();
+        VERIFY(sizeof(ShmHeader) + (mask + 1) * cellStride <= region.get_size(), "Invalid shared memory segment size");
+    }
+
+    void setup()
+    {
+        mask = h->capacity - 1;
+        slotSize = h->slotSize;
+        cellStride = stride(slotSize);
+        cells = static_cast<char*>(region.get_address()) + sizeof(ShmHeader);
+    }
+
+    ShmCell& cell(uint64_t pos)
+    {
+        return *reinterpret_cast<ShmCell*>(cells + (pos & mask) * cellStride);
+    }
+
+    static char* data(ShmCell& c)
+    {
+        return reinterpret_cast<char*>(&c + 1);
+    }
+
+    // the same algorithm as MpmcRing over the cells of the segment
+    bool tryPush(const std::string& record)
+    {
+        uint64_t pos = h->enqueuePos.load(std::memory_order_relaxed);
+        ShmCell* c;
+        while (true)
+        {
+            c = &cell(pos);
+            uint64_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (dif == 0)
+            {
+                if (h->enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (dif < 0)
+                return false;
+            else
+                pos = h->enqueuePos.load(std::memory_order_relaxed);
+        }
+        std::memcpy(data(*c), record.data(), record.size());
+        c->size = static_cast<uint32_t>(record.size());
+        c->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(std::string& record)
+    {
+        uint64_t pos = h->dequeuePos.load(std::memory_order_relaxed);
+        ShmCell* c;
+        while (true)
+        {
+            c = &cell(pos);
+            uint64_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (dif == 0)
+            {
+                if (h->dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (dif < 0)
+                return false;
+            else
+                pos = h->dequeuePos.load(std::memory_order_relaxed);
+        }
+        record.assign(data(*c), c->size);
+        c->seq.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool ringEmpty() const
+    {
+        return h->enqueuePos.load() == h->dequeuePos.load();
+    }
+
+    bool ringFull() const
+    {
+        return h->enqueuePos.load() - h->dequeuePos.load() > mask;
+    }
+
+    bool closed() const
+    {
+        return h->closed.load() != 0;
+    }
+
+    // wakes the sleeping watchers after the ring modification,
+    // the fence pairs with the increment of the sleepers
+    void notify0()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (h->sleepers.load(std::memory_order_relaxed) == 0)
+            return;
+        h->seq.fetch_add(1);
+        futexWakeAll(h->seq);
+    }
+
+    // wakes the watchers unconditionally
+    void kick0()
+    {
+        h->seq.fetch_add(1);
+        futexWakeAll(h->seq);
+    }
+
+    // the watcher serves the parked journey
+    void wait0(Lock& lock, ShmWaiters& ws, ShmWaiter& w)
+    {
+        suspend(lock, ws, w, [this] {
+            kick0();
+        });
+    }
+
+    // transfers the records to/from the parked journeys,
+    // returns the journeys to be resumed
+    ShmWaiter* serve0()
+    {
+        ShmWaiter* ready = nullptr;
+        auto done = [&ready](ShmWaiter* w) {
+            w->next = ready;
+            ready = w;
+        };
+        bool moved = true;
+        while (moved)
+        {
+            moved = false;
+            if (ShmWaiter* w = getters.pop())
+            {
+                if (tryPop(*w->out))
+                {
+                    notify0();
+                    done(w);
+                    moved = true;
+                }
+                else if (closed())
+                {
+                    w->ok = false;
+                    done(w);
+                    moved = true;
+                }
+                else
+                    getters.push(*w);
+            }
+            if (ShmWaiter* w = putters.pop())
+            {
+                if (closed())
+                {
+                    w->ok = false;
+                    done(w);
+                    moved = true;
+                }
+                else if (tryPush(*w->in))
+                {
+                    notify0();
+                    done(w);
+                    moved = true;
+                }
+                else
+                    putters.push(*w);
+            }
+        }
+        return ready;
+    }
+
+    void watch0()
+    {
+        while (true)
+        {
+            // the snapshot is taken before the ring checks thus any later kick is noticed
+            uint32_t seq = h->seq.load();
+            bool hasGetters;
+            bool hasPutters;
+            ShmWaiter* ready;
+            {
+                Lock lock(mutex);
+                if (stopping)
+                    return;
+                ready = serve0();
+                hasGetters = !getters.empty();
+                hasPutters = !putters.empty();
+            }
+            if (ready)
+            {
+                while (ready)
+                {
+                    ShmWaiter* w = ready;
+                    ready = ready->next;
+                    Handler proc = std::move(w->proc);
+                    proc();
+                }
+                continue;
+            }
+            if (!hasGetters && !hasPutters)
+            {
+                // the ring modifications are not interesting, waits for the kick only
+                futexWait(h->seq, seq);
+                continue;
+            }
+            h->sleepers.fetch_add(1);
+            // rechecks the ring after the increment: the notifier either sees
+            // the sleeper or its modification is visible here
+            bool awake = closed() || (hasGetters && !ringEmpty()) || (hasPutters && !ringFull());
+            if (!awake)
+                futexWait(h->seq, seq);
+            h->sleepers.fetch_sub(1);
+        }
+    }
+
+    std::string name;
+    bool owner;
+    bip::shared_memory_object shm;
+    bip::mapped_region region;
+    ShmHeader* h = nullptr;
+    char* cells = nullptr;
+    uint64_t mask = 0;
+    size_t slotSize = 0;
+    size_t cellStride = 0;
+
+    std::mutex mutex;
+    ShmWaiters getters;
+    ShmWaiters putters;
+    bool stopping = false;
+    std::thread watcher;
+};
+
+ShmQueue::ShmQueue(const std::string& name, ShmMode mode, size_t capacity, size_t slotSize) :
+    impl(new Impl(name, mode, capacity, slotSize))
+{
+    Impl& i = *impl;
+    i.watcher = mt::createThread([&i] { i.watch0(); }, 0, "shm");
+}
+
+ShmQueue::~ShmQueue()
+{
+    Impl& i = *impl;
+    {
+        Lock lock(i.mutex);
+        i.stopping = true;
+    }
+    i.kick0();
+    i.watcher.join();
+}
+
+bool ShmQueue::put(const std::string& record)
+{
+    Impl& i = *impl;
+    VERIFY(record.size() <= i.slotSize, "Record is too large for the slot");
+    if (i.closed())
+        return false;
+    if (i.tryPush(record))
+    {
+        i.notify0();
+        return true;
+    }
+    Lock lock(i.mutex);
+    ShmWaiter w;
+    w.in = &record;
+    i.wait0(lock, i.putters, w);
+    return w.ok;
+}
+
+bool ShmQueue::get(std::string& record)
+{
+    Impl& i = *impl;
+    if (i.tryPop(record))
+    {
+        i.notify0();
+        return true;
+    }
+    if (i.closed())
+    {
+        if (!i.tryPop(record))
+            return false;
+        i.notify0();
+        return true;
+    }
+    Lock lock(i.mutex);
+    ShmWaiter w;
+    w.out = &record;
+    i.wait0(lock, i.getters, w);
+    return w.ok;
+}
+
+bool ShmQueue::empty() const
+{
+    return impl->ringEmpty();
+}
+
+void ShmQueue::close()
+{
+    Impl& i = *impl;
+    i.h->closed.store(1);
+    i.kick0();
+}
+
+}}
+
+#endif
@@ -0,0 +1,251 @@
+/*
+ * Copyright 2014 Grigory Demchenko (aka gridem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <map>
+#include <fstream>
+#include <cstdio>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "spill.h"
+
+namespace synca {
+namespace detail {
+
+namespace bip = boost::interprocess;
+
+// record: 32-bit header (size + 1) followed by the data, the zero header marks the end
+// of the segment thus the empty record is distinguished from the end
+typedef uint32_t RecordSize;
+
+struct Segment
+{
+    Segment(const std::string& path) :
+        file(path.c_str(), bip::read_write),
+        region(file, bip::read_write)
+    {
+    }
+
+    char* data()
+    {
+        return static_cast<char*>(region.get_address());
+    }
+
+    bip::file_mapping file;
+    bip::mapped_region region;
+};
+
+typedef std::unique_ptr<Segment> SegmentPtr;
+
+struct SegmentLog::Impl
+{
+    Impl(const std::string& prefix_, size_t segmentSize_, bool durable_) :
+        prefix(prefix_), segmentSize(segmentSize_), durable(durable_)
+    {
+        VERIFY(segmentSize > 2 * sizeof(RecordSize), "Segment size is too small");
+    }
+
+    std::string path(uint64_t segment) const
+    {
+        return prefix + "." + std::to_string(segment);
+    }
+
+    std::string checkpointPath() const
+    {
+        return prefix + ".checkpoint";
+    }
+
+    bool exists(uint64_t segment) const
+    {
+        return std::ifstream(path(segment).c_str()).good();
+    }
+
+    void create(uint64_t segment)
+    {
+        std::filebuf f;
+        VERIFY(f.open(path(segment).c_str(), std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary),
+            "Cannot create segment: " + path(segment));
+        f.pubseekoff(segmentSize - 1, std::ios::beg);
+        f.sputc(0);
+    }
+
+    Segment& segment(uint64_t index)
+    {
+        auto& s = segments[index];
+        if (!s)
+            s.reset(new Segment(path(index)));
+        return *s;
+    }
+
+    // releases the mapping of the sealed segment which is not read
+    void release(uint64_t index)
+    {
+        if (index != read.segment)
+            segments.erase(index);
+    }
+
+    void remove(uint64_t index)
+    {
+        segments.erase(index);
+        std::remove(path(index).c_str());
+    }
+
+    // returns the header of the record, 0 at the end of the segment
+    RecordSize headerAt(SegmentPosition p)
+    {
+        if (p.offset + sizeof(RecordSize) > segmentSize)
+            return 0;
+        RecordSize header;
+        std::memcpy(&header, segment(p.segment).data() + p.offset, sizeof(header));
+        return header;
+    }
+
+    // restores the positions from the checkpoint and the segment contents
+    bool resume()
+    {
+        std::ifstream f(checkpointPath().c_str());
+        if (!(f >> read.segment >> read.offset))
+            return false;
+        first = read.segment;
+        write = read;
+        while (exists(write.segment + 1))
+        {
+            ++ write.segment;
+            write.offset = 0;
+        }
+        if (!exists(write.segment))
+            return false;
+        for (RecordSize header; (header = headerAt(write)) != 0;)
+            write.offset += sizeof(RecordSize) + header - 1;
+        release(write.segment);
+        return true;
+    }
+
+    // the prefix must be dedicated to the log, stale segments are removed
+    void start()
+    {
+        uint64_t s = 0;
+        std::ifstream(checkpointPath().c_str()) >> s;
+        std::remove(checkpointPath().c_str());
+        for (; exists(s); ++ s)
+            std::remove(path(s).c_str());
+        for (s = 1; exists(s); ++ s)
+            std::remove(path(s).c_str());
+        read = write = SegmentPosition{0, 0};
+        first = 0;
+        create(0);
+    }
+
+    std::string prefix;
+    size_t segmentSize;
+    // the durable log keeps the segments until the checkpoint
+    bool durable;
+    uint64_t first;
+    SegmentPosition read;
+    SegmentPosition write;
+    std::map<uint64_t, SegmentPtr> segments;
+};
+
+SegmentLog::SegmentLog(const std::string& prefix, size_t segmentSize, bool durable) :
+    impl(new Impl(prefix, segmentSize, durable))
+{
+    if (!durable || !impl->resume())
+        impl->start();
+}
+
+SegmentLog::~SegmentLog()
+{
+    Impl& i = *impl;
+    if (i.durable)
+        return;
+    for (uint64_t s = i.read.segment; s <= i.write.segment; ++ s)
+        i.remove(s);
+}
+
+void SegmentLog::append(const std::string& record)
+{
+    Impl& i = *impl;
+    size_t need = sizeof(RecordSize) + record.size();
+    // the record is followed by the zero header or the segment end
+    VERIFY(need + sizeof(RecordSize) <= i.segmentSize, "Record is too large for the segment");
+    if (i.write.offset + need + sizeof(RecordSize) > i.segmentSize)
+    {
+        i.release(i.write.segment);
+        ++ i.write.segment;
+        i.write.offset = 0;
+        i.create(i.write.segment);
+    }
+    char* p = i.segment(i.write.segment).data() + i.write.offset;
+    RecordSize header = static_cast<RecordSize>(record.size() + 1);
+    std::memcpy(p + sizeof(header), record.data(), record.size());
+    std::memcpy(p, &header, sizeof(header));
+    i.write.offset += need;
+}
+
+bool SegmentLog::read(std::string& record)
+{
+    Impl& i = *impl;
+    while (!empty())
+    {
+        RecordSize header = i.headerAt(i.read);
+        if (header == 0)
+        {
+            // the segment is consumed
+            if (i.durable)
+                i.segments.erase(i.read.segment);
+            else
+                i.remove(i.read.segment);
+            ++ i.read.segment;
+            i.read.offset = 0;
+            continue;
+        }
+        RecordSize size = header - 1;
+        const char* p = i.segment(i.read.segment).data() + i.read.offset + sizeof(header);
+        record.assign(p, size);
+        i.read.offset += sizeof(header) + size;
+        return true;
+    }
+    return false;
+}
+
+bool SegmentLog::empty() const
+{
+    return impl->read.segment == impl->write.segment && impl->read.offset == impl->write.offset;
+}
+
+SegmentPosition SegmentLog::position() const
+{
+    return impl->read;
+}
+
+void SegmentLog::checkpoint(SegmentPosition consumed)
+{
+    Impl& i = *impl;
+    for (auto&& s: i.segments)
+        s.second->region.flush();
+    std::string tmp = i.checkpointPath() + ".tmp";
+    {
+        std::ofstream f(tmp.c_str(), std::ios::trunc);
+        f << consumed.segment << " " << consumed.offset << std::endl;
+        VERIFY(f.good(), "Cannot write checkpoint: " + tmp);
+    }
+    VERIFY(std::rename(tmp.c_str(), i.checkpointPath().c_str()) == 0,
+        "Cannot store checkpoint: " + i.checkpointPath());
+    for (; i.first < consumed.segment; ++ i.first)
+        i.remove(i.first);
+}
+
+}}
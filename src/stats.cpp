@@ -0,0 +1,357 @@
+/*
+ * Copyright 2014 Grigory Demchenko (aka gridem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include <map>
+#include <sstream>
+#include <iomanip>
+
+#include "stats.h"
+#include "mt.h"
+#include "helpers.h"
+
+namespace stats {
+
+Histogram::Histogram()
+{
+    for (auto& b: buckets)
+        b = 0;
+}
+
+void Histogram::record(uint64_t value)
+{
+    buckets[index0(value)].fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::count() const
+{
+    uint64_t total = 0;
+    for (auto& b: buckets)
+        total += b.load(std::memory_order_relaxed);
+    return total;
+}
+
+uint64_t Histogram::percentile(double p) const
+{
+    uint64_t total = count();
+    if (total == 0)
+        return 0;
+    uint64_t target = static_cast<uint64_t>(p * total);
+    if (target == 0)
+        target = 1;
+    uint64_t counted = 0;
+    for (int i = 0; i < BUCKETS; ++ i)
+    {
+        counted += buckets[i].load(std::memory_order_relaxed);
+        if (counted >= target)
+            return upper0(i);
+    }
+    return upper0(BUCKETS - 1);
+}
+
+int Histogram::index0(uint64_t value)
+{
+    if (value < SUB_COUNT)
+        return static_cast<int>(value);
+    int msb = 0;
+    for (uint64_t v = value; v >>= 1;)
+        ++ msb;
+    int shift = msb - SUB_BITS;
+    return (shift + 1) * SUB_COUNT + static_cast<int>((value >> shift) & (SUB_COUNT - 1));
+}
+
+uint64_t Histogram::upper0(int index)
+{
+    if (index < SUB_COUNT)
+        return index;
+    int shift = index / SUB_COUNT - 1;
+    uint64_t sub = index % SUB_COUNT;
+    return ((SUB_COUNT + sub) << shift) + (uint64_t(1) << shift) - 1;
+}
+
+struct Registry
+{
+    struct Entry
+    {
+        std::string name;
+        SchedulerStats stats;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<const mt::IScheduler*, std::shared_ptr<Entry>> entries;
+};
+
+Registry& registry()
+{
+    return single<Registry>();
+}
+
+SchedulerStatsPtr registerScheduler(const mt::IScheduler& s)
+{
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    auto& e = r.entries[&s];
+    if (!e)
+    {
+        e = std::make_shared<Registry::Entry>();
+        e->name = s.name();
+    }
+    // the statistics share the ownership of the entry
+    return {e, &e->stats};
+}
+
+void unregisterScheduler(const mt::IScheduler& s)
+{
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.entries.erase(&s);
+}
+
+Percentiles percentiles(const Histogram& h)
+{
+    return {h.count(), h.percentile(0.5), h.percentile(0.99), h.percentile(0.999)};
+}
+
+std::vector<SchedulerSnapshot> snapshot()
+{
+    std::vector<SchedulerSnapshot> result;
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (auto&& e: r.entries)
+    {
+        const SchedulerStats& s = e.second->stats;
+        result.push_back({
+            e.second->name,
+            s.hops.load(),
+            percentiles(s.queueWait),
+            percentiles(s.execution),
+            percentiles(s.teleport),
+            percentiles(s.portal)});
+    }
+    return result;
+}
+
+void ChannelStats::depth(uint64_t d)
+{
+    currentDepth.store(d, std::memory_order_relaxed);
+    uint64_t m = maxDepth.load(std::memory_order_relaxed);
+    while (d > m && !maxDepth.compare_exchange_weak(m, d, std::memory_order_relaxed));
+}
+
+struct ChannelRegistry
+{
+    std::mutex mutex;
+    std::map<ChannelStats*, std::string> channels;
+};
+
+ChannelRegistry& channelRegistry()
+{
+    return single<ChannelRegistry>();
+}
+
+void registerChannel(ChannelStats& s, const char* name)
+{
+    ChannelRegistry& r = channelRegistry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.channels[&s] = name;
+}
+
+void unregisterChannel(ChannelStats& s)
+{
+    ChannelRegistry& r = channelRegistry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.channels.erase(&s);
+}
+
+std::vector<ChannelSnapshot> channels()
+{
+    std::vector<ChannelSnapshot> result;
+    ChannelRegistry& r = channelRegistry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (auto&& c: r.channels)
+    {
+        const ChannelStats& s = *c.first;
+        result.push_back({
+            c.second,
+            s.currentDepth.load(),
+            s.maxDepth.load(),
+            s.puts.load(),
+            s.gets.load(),
+            s.getters.load(),
+            s.putters.load(),
+            s.blockedNs.load()});
+    }
+    return result;
+}
+
+struct StageRegistry
+{
+    struct Entry
+    {
+        StageStats stats;
+        const void* src;
+        const void* dst;
+    };
+
+    std::mutex mutex;
+    std::map<std::string, std::unique_ptr<Entry>> stages;
+};
+
+StageRegistry& stageRegistry()
+{
+    return single<StageRegistry>();
+}
+
+StageStats& stage(const char* name, const void* src, const void* dst)
+{
+    StageRegistry& r = stageRegistry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    auto& e = r.stages[name];
+    if (!e)
+        e.reset(new StageRegistry::Entry{{}, src, dst});
+    return e->stats;
+}
+
+StageProbe::StageProbe(const char* name, const void* src, const void* dst, std::function<uint64_t()> size_) :
+    st(name ? &stage(name, src, dst) : nullptr), size(std::move(size_)), last(now())
+{
+    if (st)
+        ++ st->workers;
+}
+
+StageProbe::~StageProbe()
+{
+    if (!st)
+        return;
+    flush();
+    -- st->workers;
+}
+
+void StageProbe::flush()
+{
+    st->in.fetch_add(in, std::memory_order_relaxed);
+    st->out.fetch_add(out, std::memory_order_relaxed);
+    st->errors.fetch_add(errors, std::memory_order_relaxed);
+    st->busyNs.fetch_add(busyNs, std::memory_order_relaxed);
+    st->inputBlockedNs.fetch_add(inputBlockedNs, std::memory_order_relaxed);
+    st->outputBlockedNs.fetch_add(outputBlockedNs, std::memory_order_relaxed);
+    if (size)
+        st->backlog.store(size(), std::memory_order_relaxed);
+    in = out = errors = busyNs = inputBlockedNs = outputBlockedNs = 0;
+}
+
+std::vector<StageSnapshot> stages()
+{
+    std::vector<StageSnapshot> result;
+    StageRegistry& r = stageRegistry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (auto&& e: r.stages)
+    {
+        const StageStats& s = e.second->stats;
+        result.push_back({
+            e.first,
+            s.in.load(),
+            s.out.load(),
+            s.errors.load(),
+            s.busyNs.load(),
+            s.inputBlockedNs.load(),
+            s.outputBlockedNs.load(),
+            s.backlog.load(),
+            s.workers.load(),
+            e.second->src,
+            e.second->dst});
+    }
+    return result;
+}
+
+std::string stagesTable()
+{
+    std::ostringstream o;
+    o << std::left << std::setw(16) << "stage" << std::right
+        << std::setw(10) << "workers" << std::setw(12) << "in" << std::setw(12) << "out"
+        << std::setw(8) << "errors" << std::setw(10) << "backlog"
+        << std::setw(12) << "busy,ms" << std::setw(12) << "in wait,ms" << std::setw(12) << "out wait,ms"
+        << std::setw(12) << "ns/item" << std::endl;
+    for (auto&& s: stages())
+    {
+        o << std::left << std::setw(16) << s.name << std::right
+            << std::setw(10) << s.workers << std::setw(12) << s.in << std::setw(12) << s.out
+            << std::setw(8) << s.errors << std::setw(10) << s.backlog
+            << std::setw(12) << s.busyNs / 1000000 << std::setw(12) << s.inputBlockedNs / 1000000
+            << std::setw(12) << s.outputBlockedNs / 1000000
+            << std::setw(12) << (s.in ? s.busyNs / s.in : 0) << std::endl;
+    }
+    return o.str();
+}
+
+std::string stagesDot()
+{
+    std::vector<StageSnapshot> ss = stages();
+    std::ostringstream o;
+    o << "digraph stages {" << std::endl;
+    o << "    node [shape=box];" << std::endl;
+    for (auto&& s: ss)
+    {
+        o << "    \"" << s.name << "\" [label=\"" << s.name
+            << "\\nin " << s.in << ", out " << s.out << ", errors " << s.errors
+            << "\\nbusy " << s.busyNs / 1000000 << "ms, in wait " << s.inputBlockedNs / 1000000
+            << "ms, out wait " << s.outputBlockedNs / 1000000 << "ms\"];" << std::endl;
+    }
+    // the stages are connected by the same channel
+    for (auto&& from: ss)
+    {
+        for (auto&& to: ss)
+        {
+            if (from.dst && from.dst == to.src)
+            {
+                o << "    \"" << from.name << "\" -> \"" << to.name << "\" [label=\"" << to.in
+                    << "\", weight=" << to.in << "];" << std::endl;
+            }
+        }
+    }
+    o << "}" << std::endl;
+    return o.str();
+}
+
+std::ostream& operator<<(std::ostream& o, const Percentiles& p)
+{
+    return o << "n=" << p.count << " p50=" << p.p50 << " p99=" << p.p99 << " p999=" << p.p999;
+}
+
+void dump()
+{
+    for (auto&& s: snapshot())
+    {
+        RLOG("stats " << s.name << ": hops=" << s.hops);
+        RLOG("  queue wait, ns: " << s.queueWait);
+        RLOG("  execution, ns:  " << s.execution);
+        RLOG("  teleport, ns:   " << s.teleport);
+        RLOG("  portal, ns:     " << s.portal);
+    }
+    for (auto&& c: channels())
+    {
+        RLOG("channel " << c.name << ": depth=" << c.depth << " max=" << c.maxDepth
+            << " puts=" << c.puts << " gets=" << c.gets
+            << " getters=" << c.getters << " putters=" << c.putters
+            << " blocked, ns=" << c.blockedNs);
+    }
+    if (!stages().empty())
+        RLOG("stages:" << std::endl << stagesTable());
+}
+
+}
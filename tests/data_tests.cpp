@@ -14,8 +14,30 @@
  * limitations under the License.
  */
 
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <cctype>
+#include <fstream>
+#include <cstdio>
+
+#ifndef flagMSC
+#   include <sys/resource.h>
+#endif
+
 #include "data.h"
+#include "pipeline.h"
 #include "channel.h"
+#include "ring.h"
+#include "select.h"
+#include "broadcast.h"
+#include "spill.h"
+#include "shm.h"
+#include "network.h"
+#include "stats.h"
 #include "mt.h"
 #include "helpers.h"
 
@@ -47,6 +69,35 @@ bool isEmpty(const StrPair& s)
     return isEmpty(s.first);
 }
 
+typedef std::chrono::steady_clock Clock;
+
+double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// peak resident set size in KB
+long peakRss()
+{
+#ifdef flagMSC
+    return 0;
+#else
+    rusage u;
+    getrusage(RUSAGE_SELF, &u);
+    return u.ru_maxrss;
+#endif
+}
+
+// emulates slow consumer
+int slowWork(const Str& s)
+{
+    int sum = 0;
+    for (int i = 0; i < 20; ++ i)
+        for (char c: s)
+            sum += c ^ i;
+    return sum;
+}
+
 void pipe1()
 {
     ThreadPool tp(3, "tp");
@@ -132,6 +183,1437 @@ void pipe4()
     TLOG("v: " << v);
 }
 
+void bounded1()
+{
+    const int N = 20000;
+    const size_t SIZE = 4096;
+
+    ThreadPool tp(2, "tp");
+    scheduler<DefaultTag>().attach(tp);
+    // bounded channel first: peak RSS is monotonic
+    for (size_t capacity: {16, 0})
+    {
+        Channel<Str> c(capacity);
+        auto start = Clock::now();
+        go([&c] {
+            auto cl = closer(c);
+            for (int i = 0; i < N; ++ i)
+                c.put(Str(SIZE, 'a' + i % 26));
+        });
+        int sum = 0;
+        go([&c, &sum] {
+            for (auto&& s: c)
+                sum += slowWork(s);
+        });
+        waitForAll();
+        RTLOG("capacity: " << capacity << ", items/s: " << N / secondsSince(start)
+            << ", peak rss, KB: " << peakRss() << ", sum: " << sum);
+    }
+}
+
+template<typename T_channel>
+void benchChannel(const char* name, int producers, int consumers)
+{
+    const int N = 200000;
+
+    T_channel c(DEFAULT_RING_CAPACITY);
+    std::atomic<long> sum(0);
+    auto start = Clock::now();
+    c.addProducer(producers);
+    goN(producers, [&c, producers] {
+        auto p = producer(c);
+        for (int i = 0; i < N / producers; ++ i)
+            c.put(i);
+    });
+    goN(consumers, [&c, &sum] {
+        long s = 0;
+        for (int v: c)
+            s += v;
+        sum += s;
+    });
+    waitForAll();
+    RTLOG(name << ": producers: " << producers << ", consumers: " << consumers
+        << ", items/s: " << N / secondsSince(start) << ", sum: " << sum);
+}
+
+void ring1()
+{
+    ThreadPool tp(std::thread::hardware_concurrency(), "tp");
+    scheduler<DefaultTag>().attach(tp);
+    for (int n: {1, 2, 4, 8})
+    {
+        benchChannel<Channel<int>>("mutex", n, n);
+        benchChannel<RingChannel<int>>("ring", n, n);
+    }
+}
+
+void spsc1()
+{
+    ThreadPool tp(std::thread::hardware_concurrency(), "tp");
+    scheduler<DefaultTag>().attach(tp);
+    benchChannel<Channel<int>>("mutex", 1, 1);
+    benchChannel<RingChannel<int>>("ring", 1, 1);
+    benchChannel<Channel<int, Spsc>>("spsc", 1, 1);
+
+    // small capacity to exercise parking on both sides
+    Channel<int, Spsc> c1(4);
+    Channel<int, Spsc> c2(4);
+    piping1to1(c1, c2, [](int v) {
+        return v + 1;
+    });
+    long sum = 0;
+    go([&c2, &sum] {
+        for (int v: c2)
+            sum += v;
+    });
+    go([&c1] {
+        auto c = closer(c1);
+        for (int i = 0; i < 10000; ++ i)
+            c1.put(i);
+    });
+    waitForAll();
+    RTLOG("spsc pipe sum: " << sum);
+    VERIFY(sum == 10000L * 10001 / 2, "Invalid spsc pipe sum");
+}
+
+void batch1()
+{
+    const int N = 1 << 20;
+
+    ThreadPool tp(std::thread::hardware_concurrency(), "tp");
+    scheduler<DefaultTag>().attach(tp);
+    // the batch of 1 is the per item transfer
+    double perItem = 0;
+    for (size_t batch = 1; batch <= 1024; batch *= 4)
+    {
+        // bounded to exercise suspended putters
+        Channel<int> c(4096);
+        int64_t sum = 0;
+        auto start = Clock::now();
+        go([&c, batch] {
+            auto cl = closer(c);
+            std::vector<int> vals;
+            for (int i = 0; i < N; ++ i)
+            {
+                vals.push_back(i);
+                if (vals.size() == batch)
+                {
+                    c.putMany(vals);
+                    vals.clear();
+                }
+            }
+            c.putMany(vals);
+        });
+        go([&c, &sum, batch] {
+            for (auto&& vals: c.batches(batch))
+                for (int v: vals)
+                    sum += v;
+        });
+        waitForAll();
+        double t = secondsSince(start);
+        if (batch == 1)
+            perItem = t;
+        RTLOG("batch: " << batch << ", ns/item: " << t * 1e9 / N << ", items/s: " << N / t
+            << ", speedup: " << perItem / t);
+        VERIFY(sum == int64_t(N) * (N - 1) / 2, "Invalid batch sum");
+    }
+}
+
+void select1()
+{
+    const int N = 10000;
+
+    ThreadPool tp(3, "tp");
+    scheduler<DefaultTag>().attach(tp);
+    service<TimeoutTag>().attach(tp);
+    // the journey exceptions are not propagated thus the results are verified outside
+    int selected = -1;
+    bool selectedOk = false;
+    int timedOut = -1;
+    bool timedOutOk = true;
+    int lostPut = -1;
+    int lostValue = 0;
+    int fullValue = 0;
+    int putSelected = -1;
+    bool putOk = false;
+    int putValue = 0;
+    int closedSelected = -1;
+    bool closedOk = true;
+    int v1 = 0;
+    int v2 = 0;
+    go([&] {
+        Channel<int> c1;
+        Channel<int> c2;
+        go([&c2] {
+            sleepFor(10);
+            c2.put(2);
+        });
+        Select s;
+        selected = s.get(c1, v1).get(c2, v2).wait();
+        selectedOk = s.ok();
+        JLOG("selected: " << selected << ", value: " << v2);
+
+        Select t;
+        timedOut = t.get(c1, v1).timeout(10).wait();
+        timedOutOk = t.ok();
+
+        // the waiter of the lost put case must be delisted: both cases
+        // are enlisted before the get case is ready
+        Channel<int> full(1);
+        full.put(10);
+        go([&c1] {
+            sleepFor(10);
+            c1.put(1);
+        });
+        Select p;
+        lostPut = p.put(full, 11).get(c1, v1).wait();
+        lostValue = v1;
+        fullValue = full.get();
+        Select q;
+        putSelected = q.put(full, 12).timeout(1000).wait();
+        putOk = q.ok();
+        putValue = full.get();
+
+        c1.close();
+        Select c;
+        closedSelected = c.get(c1, v1).get(c2, v2).wait();
+        closedOk = c.ok();
+    });
+    waitForAll();
+    VERIFY(selected == 1 && selectedOk && v2 == 2, "Invalid selected get");
+    VERIFY(timedOut == Select::TIMEDOUT, "Timeout expected");
+    VERIFY(!timedOutOk, "Timeout must not be ok");
+    VERIFY(lostPut == 1 && lostValue == 1, "Invalid selected get with full channel");
+    VERIFY(fullValue == 10, "Invalid full channel value");
+    VERIFY(putSelected == 0 && putOk && putValue == 12, "Invalid selected put");
+    VERIFY(closedSelected == 0 && !closedOk, "Closed channel must be selected");
+
+    // values are neither lost nor duplicated by the concurrent cases
+    Channel<int> c1(16);
+    Channel<int> c2(16);
+    long sum = 0;
+    for (Channel<int>* c: {&c1, &c2})
+    {
+        go([c] {
+            auto cl = closer(*c);
+            for (int i = 1; i <= N; ++ i)
+                c->put(i);
+        });
+    }
+    go([&c1, &c2, &sum] {
+        std::vector<Channel<int>*> open = {&c1, &c2};
+        while (!open.empty())
+        {
+            int v = 0;
+            Select s;
+            for (auto c: open)
+                s.get(*c, v);
+            int i = s.wait();
+            if (s.ok())
+                sum += v;
+            else
+                open.erase(open.begin() + i);
+        }
+    });
+    waitForAll();
+    RTLOG("select sum: " << sum);
+    VERIFY(sum == 2L * N * (N + 1) / 2, "Invalid select sum");
+}
+
+void try1()
+{
+    ThreadPool tp(2, "tp");
+    scheduler<DefaultTag>().attach(tp);
+    service<TimeoutTag>().attach(tp);
+    Channel<int> c(1);
+    int v = 0;
+    VERIFY(c.tryGet(v) == CS_EMPTY, "Empty expected");
+    VERIFY(c.tryPut(1) == CS_OK, "Put expected");
+    int w = 2;
+    VERIFY(c.tryPut(std::move(w)) == CS_FULL && w == 2, "Full expected");
+    VERIFY(c.tryGet(v) == CS_OK && v == 1, "Get expected");
+
+    // the journey exceptions are not propagated thus the results are verified outside
+    ChannelStatus timedOut = CS_OK;
+    ChannelStatus timedGet = CS_TIMEDOUT;
+    ChannelStatus lost = CS_EMPTY;
+    ChannelStatus closed = CS_OK;
+    ChannelStatus closedGet = CS_OK;
+    ChannelStatus closedPut = CS_OK;
+    bool selectedPut = true;
+    int got = 0;
+    int kept = 0;
+    double elapsed = 0;
+    go([&] {
+        auto start = Clock::now();
+        timedOut = c.getFor(v, 20);
+        elapsed = secondsSince(start);
+        JLOG("timed out in, s: " << elapsed);
+
+        go([&c] {
+            sleepFor(10);
+            c.put(3);
+        });
+        timedGet = c.getFor(got, 1000);
+
+        // the waiter removed on timeout must not consume the value
+        c.put(4);
+        lost = c.tryGet(kept);
+
+        c.close();
+        closed = c.tryGet(v);
+        closedGet = c.getFor(v, 1000);
+
+        // the closed channel which is not full rejects the values
+        closedPut = c.tryPut(5);
+        Select p;
+        p.put(c, 6).wait();
+        selectedPut = p.ok();
+        closed = c.tryGet(v);
+    });
+    waitForAll();
+    VERIFY(timedOut == CS_TIMEDOUT, "Timeout expected");
+    VERIFY(elapsed >= 0.015, "Too early timeout");
+    VERIFY(timedGet == CS_OK && got == 3, "Timed get expected");
+    VERIFY(lost == CS_OK && kept == 4, "Value lost");
+    VERIFY(closed == CS_CLOSED, "Closed expected");
+    VERIFY(closedGet == CS_CLOSED, "Closed expected for timed get");
+    VERIFY(closedPut == CS_CLOSED && !selectedPut, "Closed expected for put");
+}
+
+// not default constructible, counts the copies
+struct Payload
+{
+    explicit Payload(int v) : value(v) {}
+    Payload(Payload&&) = default;
+    Payload& operator=(Payload&&) = default;
+    Payload(const Payload& p) : value(p.value) { ++ copies; }
+    Payload& operator=(const Payload& p) { value = p.value; ++ copies; return *this; }
+
+    int value;
+    static std::atomic<int> copies;
+};
+
+std::atomic<int> Payload::copies(0);
+
+void moveOnly1()
+{
+    const int N = 1000;
+
+    ThreadPool tp(2, "tp");
+    scheduler<DefaultTag>().attach(tp);
+
+    typedef std::unique_ptr<int> IntPtr;
+    Channel<IntPtr> c1;
+    Channel<IntPtr> c2(4);
+    piping1to1(c1, c2, [](IntPtr& v) {
+        ++ *v;
+        return std::move(v);
+    });
+    long sum = 0;
+    go([&c2, &sum] {
+        for (auto&& v: c2)
+            sum += *v;
+    });
+    go([&c1] {
+        auto c = closer(c1);
+        for (int i = 0; i < N; ++ i)
+            c1.emplace(new int(i));
+    });
+    waitForAll();
+    VERIFY(sum == long(N) * (N + 1) / 2, "Invalid move-only sum");
+
+    // both the waiting getter and the queue paths
+    Channel<Payload> p(2);
+    long psum = 0;
+    go([&p, &psum] {
+        for (auto&& v: p)
+            psum += v.value;
+    });
+    go([&p] {
+        auto c = closer(p);
+        for (int i = 0; i < N; ++ i)
+        {
+            if (i % 2)
+                p.emplace(i);
+            else
+                p.put(Payload(i));
+        }
+    });
+    waitForAll();
+    RTLOG("payload sum: " << psum << ", copies: " << Payload::copies);
+    VERIFY(psum == long(N) * (N - 1) / 2, "Invalid payload sum");
+    VERIFY(Payload::copies == 0, "Payload must not be copied");
+
+    // putMany copies the lvalue range and moves the rvalue one
+    std::vector<Payload> vals;
+    for (int i = 0; i < 4; ++ i)
+        vals.emplace_back(i);
+    Channel<Payload> q;
+    q.putMany(vals);
+    VERIFY(Payload::copies == 4 && vals.back().value == 3, "The lvalue range must be copied");
+    q.putMany(std::move(vals));
+    VERIFY(Payload::copies == 4 && q.size() == 8, "The rvalue range must be moved");
+}
+
+int spinWork(int n)
+{
+    volatile int sum = 0;
+    for (int i = 0; i < n; ++ i)
+        sum += i;
+    return sum;
+}
+
+// wait time of the getters for the many consumers,
+// the producer is slower thus the values are passed to the waiters
+void benchWakeup(const char* name, WakeupOrder order)
+{
+    const int N = 20000;
+    const int CONSUMERS = 32;
+
+    Channel<int> c(16, order);
+    stats::Histogram waits;
+    std::atomic<uint64_t> maxWait(0);
+    std::vector<int> counts(CONSUMERS);
+    auto start = Clock::now();
+    for (int i = 0; i < CONSUMERS; ++ i)
+    {
+        go([&c, &waits, &maxWait, &counts, i] {
+            int v;
+            while (true)
+            {
+                auto t = stats::now();
+                if (!c.get(v))
+                    break;
+                uint64_t w = stats::nsSince(t);
+                waits.record(w);
+                uint64_t m = maxWait;
+                while (w > m && !maxWait.compare_exchange_weak(m, w));
+                ++ counts[i];
+                spinWork(100);
+            }
+        });
+    }
+    go([&c] {
+        auto cl = closer(c);
+        for (int i = 0; i < N; ++ i)
+        {
+            spinWork(2000);
+            c.put(i);
+        }
+    });
+    waitForAll();
+    auto minmax = std::minmax_element(counts.begin(), counts.end());
+    RTLOG(name << ": items/s: " << N / secondsSince(start)
+        << ", wait p50, ns: " << waits.percentile(0.5)
+        << ", p99, ns: " << waits.percentile(0.99)
+        << ", max, ns: " << maxWait
+        << ", items per consumer: " << *minmax.first << ".." << *minmax.second);
+    VERIFY(std::accumulate(counts.begin(), counts.end(), 0) == N, "Invalid items count");
+}
+
+void fair1()
+{
+    ThreadPool tp(std::max(2u, std::thread::hardware_concurrency()), "tp");
+    scheduler<DefaultTag>().attach(tp);
+    // the getters are suspended one by one
+    for (WakeupOrder order: {WO_LIFO, WO_FIFO})
+    {
+        const int GETTERS = 3;
+        Channel<int> c(0, order);
+        std::vector<int> got(GETTERS);
+        for (int i = 0; i < GETTERS; ++ i)
+        {
+            go([&c, &got, i] {
+                got[i] = c.get();
+            });
+            sleepFor(20);
+        }
+        for (int i = 0; i < GETTERS; ++ i)
+            c.put(i);
+        waitForAll();
+        for (int i = 0; i < GETTERS; ++ i)
+            VERIFY(got[i] == (order == WO_FIFO ? i : GETTERS - 1 - i), "Invalid wakeup order");
+    }
+
+    // the getter is not delayed by the putter which runs long without suspending
+    const int ROUNDS = 20;
+    int woken = 0;
+    for (int i = 0; i < ROUNDS; ++ i)
+    {
+        Channel<int> c(0, WO_FIFO);
+        std::atomic<bool> got{false};
+        go([&c, &got] {
+            c.get();
+            got = true;
+        });
+        sleepFor(10);
+        go([&c, &got, &woken] {
+            c.put(1);
+            auto start = Clock::now();
+            while (!got && secondsSince(start) < 1);
+            if (got)
+                ++ woken;
+        });
+        waitForAll();
+    }
+    VERIFY(woken == ROUNDS, "The getter is delayed by the running putter");
+    benchWakeup("lifo", WO_LIFO);
+    benchWakeup("fifo", WO_FIFO);
+}
+
+void metrics1()
+{
+    const int N = 100;
+
+    ThreadPool tp(2, "tp");
+    scheduler<DefaultTag>().attach(tp);
+    Channel<int> c(4);
+    c.name("metrics");
+    go([&c] {
+        auto cl = closer(c);
+        for (int i = 0; i < N; ++ i)
+            c.put(i);
+    });
+    go([&c] {
+        for (int v: c)
+            spinWork(v * 1000);
+    });
+    waitForAll();
+    stats::dump();
+#ifdef flagSTATS
+    auto cs = stats::channels();
+    auto it = std::find_if(cs.begin(), cs.end(), [](const stats::ChannelSnapshot& s) {
+        return s.name == "metrics";
+    });
+    VERIFY(it != cs.end(), "Channel must be registered");
+    VERIFY(it->puts == N && it->gets == N, "Invalid puts/gets");
+    VERIFY(it->maxDepth <= 4 && it->depth == 0, "Invalid depth");
+    VERIFY(it->getters == 0 && it->putters == 0, "Invalid suspended journeys");
+#endif
+}
+
+void broadcast1()
+{
+    const int N = 10000;
+
+    ThreadPool tp(3, "tp");
+    scheduler<DefaultTag>().attach(tp);
+
+    // the slow subscriber blocks the publisher, the payload is shared
+    BroadcastChannel<Str> b(4);
+    auto& fast = b.subscribe();
+    auto& slow = b.subscribe();
+    const Str* first[2] = {nullptr, nullptr};
+    long sums[2] = {0, 0};
+    int i = 0;
+    for (auto s: {&fast, &slow})
+    {
+        go([s, &first, &sums, i] {
+            BroadcastChannel<Str>::Ptr v;
+            while (s->get(v))
+            {
+                if (first[i] == nullptr)
+                    first[i] = v.get();
+                sums[i] += v->size();
+                if (i == 1)
+                    sleepFor(0);
+            }
+        });
+        ++ i;
+    }
+    go([&b] {
+        auto c = closer(b);
+        for (int i = 0; i < N; ++ i)
+            b.put(Str(i % 100, 'a'));
+    });
+    waitForAll();
+    RTLOG("broadcast sums: " << sums[0] << ", " << sums[1]);
+    VERIFY(sums[0] == sums[1] && sums[0] == (N / 100) * 99 * 100 / 2, "Invalid broadcast sums");
+    VERIFY(first[0] == first[1], "Payload must be shared");
+
+    // the idle subscriber loses the oldest values
+    BroadcastChannel<int> d(4, OP_DROP_OLDEST);
+    auto& idle = d.subscribe();
+    go([&d] {
+        for (int i = 0; i < 10; ++ i)
+            d.put(i);
+        d.close();
+    });
+    waitForAll();
+    std::vector<int> vs;
+    go([&idle, &vs] {
+        for (int v: idle)
+            vs.push_back(v);
+    });
+    waitForAll();
+    VERIFY(idle.dropped() == 6, "Invalid dropped count");
+    VERIFY((vs == std::vector<int>{6, 7, 8, 9}), "Invalid values after drop");
+}
+
+bool fileExists(const Str& path)
+{
+    return std::ifstream(path.c_str()).good();
+}
+
+void spill1()
+{
+    const int N = 100000;
+    const Str prefix = "spill1.log";
+
+    ThreadPool tp(2, "tp");
+    scheduler<DefaultTag>().attach(tp);
+
+    // the slow consumer does not bound the producer, the middle goes to disk
+    {
+        SpillChannel<Str> c(prefix, 64, false, 64 * 1024);
+        int next = 0;
+        go([&c, &next] {
+            for (auto&& s: c)
+            {
+                VERIFY(s == std::to_string(next), "Invalid spilled order");
+                ++ next;
+            }
+        });
+        go([&c] {
+            for (int i = 0; i < N; ++ i)
+                c.put(std::to_string(i));
+            c.close();
+        });
+        waitForAll();
+        VERIFY(next == N, "Invalid spilled count");
+        VERIFY(!fileExists(prefix + ".0"), "Consumed segment must be removed");
+    }
+    VERIFY(!fileExists(prefix + ".1"), "Segments must be removed");
+
+    // the empty record differs from the end of the segment
+    {
+        synca::detail::SegmentLog log(prefix, 64, false);
+        const std::vector<Str> records = {"", "a", "", "", Str(40, 'b'), ""};
+        for (auto&& r: records)
+            log.append(r);
+        for (auto&& r: records)
+        {
+            Str s = "x";
+            VERIFY(log.read(s), "Empty record is lost");
+            VERIFY(s == r, "Invalid spilled record");
+        }
+        VERIFY(log.empty(), "Log must be empty");
+    }
+
+    // the durable channel resumes from the checkpoint
+    {
+        SpillChannel<int> c(prefix, 64, true, 4096);
+        for (int i = 0; i < 1000; ++ i)
+            c.put(i);
+        go([&c] {
+            for (int i = 0; i < 300; ++ i)
+                VERIFY(c.get() == i, "Invalid durable order");
+            c.checkpoint();
+            c.get();
+        });
+        waitForAll();
+    }
+    {
+        SpillChannel<int> c(prefix, 64, true, 4096);
+        int next = 300;
+        go([&c, &next] {
+            c.close();
+            for (int v: c)
+                VERIFY(v == next ++, "Invalid resumed value");
+        });
+        waitForAll();
+        VERIFY(next == 1000, "Invalid resumed count");
+        VERIFY(!c.put(1000) && c.empty(), "The closed channel must reject the value");
+        c.checkpoint();
+    }
+    SpillChannel<int>(prefix, 64, false, 4096);
+    std::remove((prefix + ".checkpoint").c_str());
+}
+
+// destination which records the closing
+struct Sink : Producers<Sink>
+{
+    void put(int)
+    {
+        ++ count;
+    }
+
+    void close()
+    {
+        closed = true;
+    }
+
+    std::atomic<int> count{0};
+    std::atomic<bool> closed{false};
+};
+
+void producers1()
+{
+    const int N = 1000;
+
+    ThreadPool tp(2, "tp");
+    scheduler<DefaultTag>().attach(tp);
+    Channel<int> src;
+    Channel<int> gate;
+    Sink dst;
+    for (int i = 0; i < N; ++ i)
+        src.put(i);
+    src.close();
+    bool open = false;
+    // the worker with the first value is completed after all the others
+    piping1to1(src, dst, [&gate, &dst, &open](int v) {
+        if (v == 0)
+        {
+            gate.get();
+            open = !dst.closed;
+        }
+        return v;
+    }, 8);
+    WAIT_FOR(dst.count == N - 1);
+    sleepFor(100);
+    gate.put(0);
+    waitForAll();
+    VERIFY(open, "Destination is closed before the last producer is completed");
+    VERIFY(dst.count == N && dst.closed, "Invalid destination state");
+}
+
+void pipeline1()
+{
+    const int LINES = 20000;
+    const Str LINE = "the quick brown fox jumps over the lazy dog";
+
+    ThreadPool tp(2, "tp");
+    scheduler<DefaultTag>().attach(tp);
+
+    auto split = [](const Str& line, Emitter<Str>& words) {
+        size_t s = 0;
+        for (size_t e; (e = line.find(' ', s)) != Str::npos; s = e + 1)
+            words.put(line.substr(s, e - s));
+        words.put(line.substr(s));
+    };
+    auto longWord = [](const Str& w) { return w.size() > 3; };
+    auto upper = [](const Str& w) {
+        Str r = w;
+        for (char& c: r)
+            c = std::toupper(c);
+        return r;
+    };
+
+    // the channel after each stage
+    std::map<Str, int> piped;
+    {
+        Channel<Str> lines;
+        Channel<Str> words;
+        Channel<Str> filtered;
+        Channel<Str> uppered;
+        auto start = Clock::now();
+        piping1toMany(lines, words, [](const Str& line, Channel<Str>& words) {
+            size_t s = 0;
+            for (size_t e; (e = line.find(' ', s)) != Str::npos; s = e + 1)
+                words.put(line.substr(s, e - s));
+            words.put(line.substr(s));
+        });
+        piping(words, filtered, [longWord](Channel<Str>& s, Channel<Str>& d) {
+            for (auto&& w: s)
+                if (longWord(w))
+                    d.put(w);
+        });
+        piping1to1(filtered, uppered, upper);
+        go([&uppered, &piped] {
+            for (auto&& w: uppered)
+                ++ piped[w];
+        });
+        for (int i = 0; i < LINES; ++ i)
+            lines.put(LINE);
+        lines.close();
+        waitForAll();
+        RTLOG("piping: " << secondsSince(start) << "s");
+    }
+
+    // the fused stages
+    std::map<Str, int> fused;
+    {
+        Channel<Str> lines;
+        auto start = Clock::now();
+        from(lines) | flatMap<Str>(split) | filter(longWord) | map(upper) | sink([&fused](const Str& w) {
+            ++ fused[w];
+        });
+        for (int i = 0; i < LINES; ++ i)
+            lines.put(LINE);
+        lines.close();
+        waitForAll();
+        RTLOG("pipeline: " << secondsSince(start) << "s");
+    }
+    VERIFY(fused == piped, "Invalid pipeline result");
+    VERIFY(fused["QUICK"] == LINES && fused.size() == 5, "Invalid word counts");
+
+    // the parallel stage between the fused ones
+    Channel<int> src;
+    Channel<long> dst;
+    from(src) | filter([](int v) { return v % 2 == 0; })
+        | map([](int v) { return v * 10L; }).parallel(4)
+        | map([](long v) { return v + 1; })
+        | to(dst);
+    long sum = 0;
+    go([&dst, &sum] {
+        for (long v: dst)
+            sum += v;
+    });
+    for (int i = 0; i < 1000; ++ i)
+        src.put(i);
+    src.close();
+    waitForAll();
+    VERIFY(sum == 500 * 499 * 10 + 500, "Invalid parallel pipeline sum");
+}
+
+// variable cost per value
+int variableWork(int v)
+{
+    spinWork(v % 7 == 0 ? 20000 : 1000);
+    return v;
+}
+
+template<typename F_piping>
+double benchOrdered(const char* name, F_piping piping, std::vector<int>& out)
+{
+    const int N = 20000;
+
+    Channel<int> src;
+    Channel<int> dst(DEFAULT_RING_CAPACITY);
+    auto start = Clock::now();
+    piping(src, dst);
+    go([&dst, &out] {
+        for (int v: dst)
+            out.push_back(v);
+    });
+    for (int i = 0; i < N; ++ i)
+        src.put(i);
+    src.close();
+    waitForAll();
+    double t = secondsSince(start);
+    RTLOG(name << ": items/s: " << N / t);
+    VERIFY(out.size() == N, "Invalid amount of values");
+    return t;
+}
+
+void ordered1()
+{
+    const int WORKERS = 4;
+
+    ThreadPool tp(WORKERS, "tp");
+    scheduler<DefaultTag>().attach(tp);
+
+    std::vector<int> sequential;
+    std::vector<int> unordered;
+    std::vector<int> ordered;
+    benchOrdered("sequential", [](Channel<int>& s, Channel<int>& d) {
+        piping1to1(s, d, variableWork);
+    }, sequential);
+    double tu = benchOrdered("unordered", [](Channel<int>& s, Channel<int>& d) {
+        piping1to1(s, d, variableWork, WORKERS);
+    }, unordered);
+    double to = benchOrdered("ordered", [](Channel<int>& s, Channel<int>& d) {
+        piping1to1Ordered(s, d, variableWork, WORKERS);
+    }, ordered);
+    RTLOG("ordered/unordered time: " << to / tu);
+    VERIFY(ordered == sequential, "Invalid order");
+    std::sort(unordered.begin(), unordered.end());
+    VERIFY(unordered == sequential, "Invalid unordered values");
+
+    // the failed value is skipped without blocking the successors
+    Channel<int> src;
+    Channel<int> dst;
+    piping1to1Ordered(src, dst, [](int v) {
+        VERIFY(v != 3, "Value 3 fails");
+        return v;
+    }, WORKERS, 2);
+    std::vector<int> vs;
+    go([&dst, &vs] {
+        for (int v: dst)
+            vs.push_back(v);
+    });
+    for (int i = 0; i < 10; ++ i)
+        src.put(i);
+    src.close();
+    waitForAll();
+    VERIFY((vs == std::vector<int>{0, 1, 2, 4, 5, 6, 7, 8, 9}), "Invalid values after failure");
+}
+
+// skewed word frequencies like in the natural text
+std::vector<Str> makeCorpus(size_t words, size_t vocabulary)
+{
+    std::vector<Str> corpus;
+    corpus.reserve(words);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < words; ++ i)
+    {
+        seed = seed * 1103515245 + 12345;
+        double r = (seed >> 8) / double(1 << 24);
+        corpus.push_back("w" + std::to_string(size_t(vocabulary * r * r * r)));
+    }
+    return corpus;
+}
+
+template<typename F_count>
+double benchCount(const char* name, const std::vector<Str>& corpus, F_count count,
+    std::unordered_map<Str, size_t>& out)
+{
+    Channel<Str> words;
+    Channel<std::pair<Str, size_t>> counted;
+    auto start = Clock::now();
+    count(words, counted);
+    go([&counted, &out] {
+        for (auto&& kv: counted)
+            out[kv.first] += kv.second;
+    });
+    go([&words, &corpus] {
+        auto c = closer(words);
+        words.putMany(corpus);
+    });
+    waitForAll();
+    double t = secondsSince(start);
+    RTLOG(name << ": words/s: " << corpus.size() / t);
+    return t;
+}
+
+void reduce1()
+{
+    const int WORKERS = 4;
+
+    ThreadPool tp(WORKERS, "tp");
+    scheduler<DefaultTag>().attach(tp);
+
+    std::vector<Str> corpus = makeCorpus(1000000, 100000);
+    std::unordered_map<Str, size_t> expected;
+    for (auto&& w: corpus)
+        ++ expected[w];
+
+    // the single map like in the sink of the pipeline
+    std::unordered_map<Str, size_t> sequential;
+    double t1 = benchCount("single map", corpus, [](Channel<Str>& s, Channel<std::pair<Str, size_t>>& d) {
+        go([&s, &d] {
+            auto c = closer(d);
+            std::unordered_map<Str, size_t> m;
+            for (auto&& w: s)
+                ++ m[w];
+            for (auto&& kv: m)
+                d.put(kv);
+        });
+    }, sequential);
+    VERIFY(sequential == expected, "Invalid single map counts");
+    for (int n = 1; n <= WORKERS; n *= 2)
+    {
+        std::unordered_map<Str, size_t> counted;
+        Str name = "countByKey " + std::to_string(n);
+        double t = benchCount(name.c_str(), corpus, [n](Channel<Str>& s, Channel<std::pair<Str, size_t>>& d) {
+            countByKey(s, d, n);
+        }, counted);
+        RTLOG(name << " speedup: " << t1 / t);
+        VERIFY(counted == expected, "Invalid counts");
+        // the merging puts each key once
+        VERIFY(counted.size() == expected.size(), "Invalid amount of keys");
+    }
+
+    // the custom map and combine function
+    Channel<int> src;
+    Channel<std::pair<int, int>> maxes;
+    reduceByKey<std::map>(src, maxes, [](int v) { return v % 10; }, [](int v) { return v; },
+        [](int a, int b) { return std::max(a, b); }, WORKERS);
+    std::map<int, int> result;
+    go([&maxes, &result] {
+        for (auto&& kv: maxes)
+        {
+            VERIFY(result.count(kv.first) == 0, "Duplicated key");
+            result.insert(kv);
+        }
+    });
+    for (int i = 0; i < 1000; ++ i)
+        src.put(i);
+    src.close();
+    waitForAll();
+    VERIFY(result.size() == 10 && result[0] == 990 && result[9] == 999, "Invalid maximums");
+}
+
+template<typename F_route>
+double benchKeyed(const char* name, F_route route, std::vector<int>& out)
+{
+    const int N = 200000;
+    const int KEYS = 10000;
+
+    Channel<int> src;
+    Channel<int> dst;
+    auto start = Clock::now();
+    route(src, dst);
+    go([&dst, &out] {
+        for (int v: dst)
+            out.push_back(v);
+    });
+    go([&src] {
+        auto c = closer(src);
+        std::vector<int> vs;
+        for (int i = 0; i < N; ++ i)
+            vs.push_back(i * 7919 % KEYS);
+        src.putMany(vs);
+    });
+    waitForAll();
+    double t = secondsSince(start);
+    RTLOG(name << ": items/s: " << N / t);
+    std::sort(out.begin(), out.end());
+    VERIFY(out.size() == KEYS, "Invalid amount of unique values");
+    VERIFY(std::adjacent_find(out.begin(), out.end()) == out.end(), "Duplicated value");
+    return t;
+}
+
+void keyed1()
+{
+    const int WORKERS = 4;
+
+    ThreadPool tp(WORKERS, "tp");
+    scheduler<DefaultTag>().attach(tp);
+
+    // each copy of the dedupe has its own unsynchronized set
+    auto dedupe = [](Channel<int>& s, Channel<int>& d) {
+        std::unordered_set<int> seen;
+        for (int v: s)
+            if (seen.insert(v).second)
+                d.put(v);
+    };
+    auto identity = [](int v) { return v; };
+    std::vector<int> sequential;
+    std::vector<int> unbatched;
+    std::vector<int> batched;
+    benchKeyed("sequential", [dedupe](Channel<int>& s, Channel<int>& d) {
+        piping(s, d, dedupe);
+    }, sequential);
+    double t1 = benchKeyed("keyed unbatched", [&](Channel<int>& s, Channel<int>& d) {
+        pipingKeyed(s, d, identity, dedupe, WORKERS, 1);
+    }, unbatched);
+    double tb = benchKeyed("keyed batched", [&](Channel<int>& s, Channel<int>& d) {
+        pipingKeyed(s, d, identity, dedupe, WORKERS);
+    }, batched);
+    RTLOG("batched speedup: " << t1 / tb);
+    VERIFY(batched == sequential && unbatched == sequential, "Invalid keyed values");
+
+    // the partial batch is flushed when the source becomes empty
+    Channel<int> src;
+    Channel<int> dst;
+    pipingKeyed(src, dst, identity, [](Channel<int>& s, Channel<int>& d) {
+        for (int v: s)
+            d.put(v);
+    }, WORKERS);
+    std::atomic<int> got{0};
+    go([&dst, &got] {
+        got = dst.get();
+    });
+    src.put(1);
+    WAIT_FOR(got == 1);
+    src.close();
+    waitForAll();
+    VERIFY(dst.empty(), "Unexpected values");
+}
+
+template<typename F_pipe>
+double benchAdaptive(const char* name, int n, F_pipe f, Adaptive& a)
+{
+    Channel<int> src;
+    Channel<int> dst;
+    auto start = Clock::now();
+    pipingAdaptive(src, dst, f, a);
+    long long sum = 0;
+    go([&dst, &sum] {
+        for (int v: dst)
+            sum += v;
+    });
+    std::vector<int> vs(n);
+    std::iota(vs.begin(), vs.end(), 0);
+    src.putMany(vs);
+    VERIFY(src.size() > 0, "Invalid source size");
+    src.close();
+    waitForAll();
+    double t = secondsSince(start);
+    auto s = a.snapshot();
+    RTLOG(name << ": items/s: " << n / t << ", peak workers: " << s.peakWorkers
+        << ", scale ups: " << s.scaleUps << ", rejected: " << s.rejected
+        << ", scale downs: " << s.scaleDowns << ", latency: " << s.latencyNs << "ns");
+    VERIFY(sum == (long long) n * (n - 1) / 2, "Invalid adaptive sum");
+    VERIFY(s.processed == (uint64_t) n && s.workers == 0, "Invalid adaptive metrics");
+    return t;
+}
+
+// the tick of the controller: the values processed by 10ms each
+int adaptiveTick(Adaptive& a, int processed, size_t depth)
+{
+    for (int i = 0; i < processed; ++ i)
+        a.processed(10 * 1000 * 1000);
+    return a.decide(depth, 0.1);
+}
+
+void adaptive1()
+{
+    const int WORKERS = 4;
+    const int IO_ITEMS = 2000;
+    const int IO_MS = 5;
+
+    ThreadPool tp(WORKERS, "tp");
+    scheduler<DefaultTag>().attach(tp);
+    service<TimeoutTag>().attach(tp);
+
+    // the decisions of the controller on the fixed ticks,
+    // the journey exceptions are not propagated thus the checks are verified outside
+    Adaptive a(1, 4, 20);
+    std::vector<std::pair<bool, Str>> checks;
+    go([&a, &checks] {
+        auto check = [&checks](bool ok, const char* msg) {
+            checks.emplace_back(ok, msg);
+        };
+        a.start();
+        check(adaptiveTick(a, 10, 100) == 1 && a.enter(), "The backlog must scale up");
+        check(adaptiveTick(a, 20, 100) == 0, "The spawned worker must settle");
+        check(adaptiveTick(a, 20, 100) == 0 && !a.retire(), "The gain must keep the probe");
+        check(adaptiveTick(a, 20, 100) == 1 && a.enter(), "The backlog must scale up again");
+        check(adaptiveTick(a, 20, 100) == 0, "The spawned worker must settle again");
+        check(adaptiveTick(a, 20, 100) == 0 && a.retire() && !a.retire(), "The probe without gain must be reverted");
+        for (int i = 0; i < 5; ++ i)
+            check(adaptiveTick(a, 20, 100) == 0, "The rejected probe must hold the scale up");
+        check(adaptiveTick(a, 2, 0) == 0 && a.retire(), "The idle worker must be retired");
+
+        // the source is closed while the excess is pending: the worker
+        // left on the closing does not prevent the retiring of the last one
+        Adaptive closing(1, 4, 20);
+        closing.start();
+        check(adaptiveTick(closing, 20, 100) == 1 && closing.enter(), "The closing stage must scale up");
+        check(adaptiveTick(closing, 20, 100) == 0, "The closing stage must settle");
+        check(adaptiveTick(closing, 20, 100) == 0, "The closing probe must be reverted");
+        check(!closing.leave() && closing.retire() == RS_LAST, "The last retired worker must be reported");
+
+        // the excess is limited by the active workers
+        Adaptive left(1, 4, 20);
+        left.start();
+        check(adaptiveTick(left, 20, 100) == 1 && left.enter(), "The left stage must scale up");
+        check(adaptiveTick(left, 20, 100) == 0 && !left.leave(), "The left stage must settle");
+        check(adaptiveTick(left, 20, 100) == 0 && left.retire() == RS_KEEP, "The last worker must be kept");
+    });
+    waitForAll();
+    for (auto&& c: checks)
+    {
+        if (!c.first)
+            RAISE("Verification failed: " + c.second);
+    }
+    auto s = a.snapshot();
+    VERIFY(s.workers == 1 && s.peakWorkers == 3, "Invalid adaptive workers");
+    VERIFY(s.scaleUps == 2 && s.rejected == 1 && s.scaleDowns == 1, "Invalid adaptive decisions");
+    VERIFY(s.latencyNs == 10 * 1000 * 1000, "Invalid adaptive latency");
+
+    // the waiting stage scales up to serve the backlog
+    Adaptive io(1, 64, 20);
+    double t = benchAdaptive("io", IO_ITEMS, [](int v, Channel<int>& d) {
+        Channel<int> never;
+        int x;
+        never.getFor(x, IO_MS);
+        d.put(v);
+    }, io);
+    VERIFY(io.snapshot().peakWorkers > 4, "The waiting stage is not scaled up");
+    RTLOG("io speedup: " << IO_ITEMS * IO_MS / 1000.0 / t);
+
+    // the idle workers waiting for the open empty source are retired
+    Adaptive idle(1, 64, 20);
+    Channel<int> src;
+    Channel<int> dst;
+    pipingAdaptive(src, dst, [](int v, Channel<int>& d) {
+        Channel<int> never;
+        int x;
+        never.getFor(x, IO_MS);
+        d.put(v);
+    }, idle);
+    go([&dst] {
+        for (int v: dst)
+            (void) v;
+    });
+    src.putMany(std::vector<int>(IO_ITEMS / 4));
+    auto start = Clock::now();
+    AdaptiveSnapshot is;
+    do
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        is = idle.snapshot();
+    } while ((is.processed < IO_ITEMS / 4 || is.workers > 1) && secondsSince(start) < 10);
+    src.close();
+    waitForAll();
+    RTLOG("idle: peak workers: " << is.peakWorkers << ", workers: " << is.workers
+        << ", scale downs: " << is.scaleDowns);
+    VERIFY(is.peakWorkers > 1 && is.workers == 1, "The idle workers are not retired");
+
+    // the cpu bound stage does not oversubscribe the thread pool
+    Adaptive cpu(1, 64, 20);
+    benchAdaptive("cpu", 20000, [](int v, Channel<int>& d) {
+        spinWork(100000);
+        d.put(v);
+    }, cpu);
+    // the probe above the amount of the threads is reverted
+    RTLOG("cpu peak workers: " << cpu.snapshot().peakWorkers << ", threads: " << WORKERS);
+}
+
+template<typename F_piping>
+double benchBatched(const char* name, const std::vector<Str>& words, F_piping piping)
+{
+    Channel<Str> src;
+    Channel<int> dst;
+    long long sum = 0;
+    // the stage only is measured
+    go([&src, &words] {
+        auto c = closer(src);
+        src.putMany(words);
+    });
+    waitForAll();
+    auto start = Clock::now();
+    piping(src, dst);
+    go([&dst, &sum] {
+        for (auto&& vs: dst.batches(DEFAULT_BATCH_SIZE))
+            for (int v: vs)
+                sum += v;
+    });
+    waitForAll();
+    double t = secondsSince(start);
+    RTLOG(name << ": ns/item: " << t * 1e9 / words.size());
+    VERIFY(sum == (long long) words.size() * 4, "Invalid batched sum");
+    return t;
+}
+
+// the sizes of the batches for the values arriving with the delay
+std::vector<int> batchSizes(int waitUs)
+{
+    Channel<int> src;
+    Channel<int> dst;
+    pipingBatched(src, dst, [](std::vector<int>& batch, std::vector<int>& sizes) {
+        sizes.push_back(int(batch.size()));
+    }, 1, 4, waitUs);
+    std::vector<int> sizes;
+    go([&dst, &sizes] {
+        for (int v: dst)
+            sizes.push_back(v);
+    });
+    go([&src] {
+        auto delay = [] {
+            Channel<int> never;
+            int x;
+            never.getFor(x, 20);
+        };
+        auto c = closer(src);
+        delay();
+        src.put(1);
+        delay();
+        src.putMany(std::vector<int>{2, 3, 4, 5});
+    });
+    waitForAll();
+    return sizes;
+}
+
+void batched1()
+{
+    const int WORKERS = 2;
+
+    ThreadPool tp(WORKERS, "tp");
+    scheduler<DefaultTag>().attach(tp);
+    service<TimeoutTag>().attach(tp);
+
+    std::vector<Str> words(1 << 20, "word");
+    double t1 = benchBatched("per item", words, [](Channel<Str>& s, Channel<int>& d) {
+        piping1to1(s, d, [](const Str& w) { return int(w.size()); }, WORKERS);
+    });
+    double tb = benchBatched("batched", words, [](Channel<Str>& s, Channel<int>& d) {
+        pipingBatched(s, d, [](std::vector<Str>& ws, std::vector<int>& lens) {
+            for (auto&& w: ws)
+                lens.push_back(int(w.size()));
+        }, WORKERS);
+    });
+    RTLOG("batched speedup: " << t1 / tb);
+
+    // the batch is filled by the values arriving within the wait time
+    VERIFY((batchSizes(1000) == std::vector<int>{1, 4}), "Invalid batches without waiting");
+    VERIFY((batchSizes(200000) == std::vector<int>{4, 1}), "Invalid batches with waiting");
+
+    // the full batch of the queued values is returned without waiting
+    Channel<int> c;
+    c.putMany(std::vector<int>{1, 2, 3, 4, 5});
+    std::vector<int> vals;
+    double elapsed = 0;
+    go([&c, &vals, &elapsed] {
+        auto start = Clock::now();
+        c.getManyFor(vals, 4, 10 * 1000 * 1000);
+        elapsed = secondsSince(start);
+    });
+    waitForAll();
+    RTLOG("full batch in, s: " << elapsed);
+    VERIFY((vals == std::vector<int>{1, 2, 3, 4}), "Invalid full batch");
+    VERIFY(elapsed < 5, "The full batch must not wait");
+
+    // the move-only value arriving within the wait time is added to the batch
+    Channel<std::unique_ptr<int>> m;
+    m.put(std::unique_ptr<int>(new int(1)));
+    std::vector<std::unique_ptr<int>> ptrs;
+    go([&m, &ptrs] {
+        m.getManyFor(ptrs, 2, 10 * 1000 * 1000);
+    });
+    go([&m] {
+        sleepFor(20);
+        m.put(std::unique_ptr<int>(new int(2)));
+    });
+    waitForAll();
+    VERIFY(ptrs.size() == 2 && *ptrs[0] == 1 && *ptrs[1] == 2, "Invalid move-only batch");
+}
+
+double benchProfile(const char* name)
+{
+    const int N = 1 << 20;
+
+    Channel<int> src;
+    Channel<int> dst;
+    go([&src] {
+        auto c = closer(src);
+        std::vector<int> vs(N);
+        src.putMany(vs);
+    });
+    waitForAll();
+    auto start = Clock::now();
+    piping1to1(src, dst, [](int v) { return v + 1; }, 1, name);
+    go([&dst] {
+        for (auto&& vs: dst.batches(DEFAULT_BATCH_SIZE))
+            VERIFY(vs.front() == 1, "Invalid value");
+    });
+    waitForAll();
+    double ns = secondsSince(start) * 1e9 / N;
+    RTLOG((name ? name : "unnamed") << ": ns/item: " << ns);
+    return ns;
+}
+
+void profile1()
+{
+    const int N = 1000;
+
+    ThreadPool tp(2, "tp");
+    scheduler<DefaultTag>().attach(tp);
+
+    Channel<int> src;
+    Channel<int> mid;
+    Channel<int> dst;
+    piping1to1(src, mid, [](int v) {
+        VERIFY(v % 100 != 0, "Value fails");
+        return v;
+    }, 2, "profile.check");
+    from(mid) | filter([](int v) { return v % 3 == 0; }) | to(dst, "profile.filter");
+    int count = 0;
+    go([&dst, &count] {
+        for (int v: dst)
+        {
+            (void) v;
+            ++ count;
+        }
+    });
+    for (int i = 0; i < N; ++ i)
+        src.put(i);
+    src.close();
+    waitForAll();
+    VERIFY(count == 330, "Invalid amount of values");
+#ifdef flagSTATS
+    std::map<Str, stats::StageSnapshot> ss;
+    for (auto&& s: stats::stages())
+        ss.insert({s.name, s});
+    VERIFY(ss.count("profile.check") && ss.count("profile.filter"), "The stages are not registered");
+    auto&& check = ss.at("profile.check");
+    auto&& filtered = ss.at("profile.filter");
+    VERIFY(check.in == N && check.out == N - 10 && check.errors == 10 && check.workers == 0,
+        "Invalid check stage counters");
+    VERIFY(filtered.in == N - 10 && filtered.src == check.dst, "Invalid filter stage");
+    RTLOG("stages:" << std::endl << stats::stagesTable());
+    Str dot = stats::stagesDot();
+    RTLOG("dot:" << std::endl << dot);
+    VERIFY(dot.find("\"profile.check\" -> \"profile.filter\" [label=\"990\"") != Str::npos, "Invalid stage graph");
+
+    // the overhead of the profiling per value
+    double unnamed = benchProfile(nullptr);
+    double named = benchProfile("profile.bench");
+    RTLOG("profiling overhead: ns/item: " << named - unnamed << ", ratio: " << named / unnamed);
+#else
+    VERIFY(stats::stages().empty(), "The stages are registered without flagSTATS");
+#endif
+}
+
+struct Message
+{
+    int id;
+    char body[60];
+};
+
+void shm1()
+{
+#ifdef __linux__
+    const int N = 100000;
+    const long long SUM = (long long) N * (N - 1) / 2;
+
+    ThreadPool tp(2, "tp");
+    scheduler<DefaultTag>().attach(tp);
+    service<NetworkTag>().attach(tp);
+
+    // the opened channel has its own mapping and watcher like in another process
+    ShmChannel<Message> out("synca-shm1", SM_CREATE, 256);
+    ShmChannel<Message> in("synca-shm1", SM_OPEN);
+    long long shmSum = 0;
+    auto start = Clock::now();
+    go([&out] {
+        Message m{};
+        for (int i = 0; i < N; ++ i)
+        {
+            m.id = i;
+            out.put(m);
+        }
+        out.close();
+    });
+    go([&in, &shmSum] {
+        for (auto&& m: in)
+            shmSum += m.id;
+    });
+    waitForAll();
+    double shmTime = secondsSince(start);
+    VERIFY(shmSum == SUM, "Invalid shm sum");
+
+    // the same payloads through the loopback socket
+    const int PORT = 8765;
+    long long socketSum = 0;
+    start = Clock::now();
+    go([&socketSum] {
+        net::Acceptor acceptor(PORT);
+        go([] {
+            net::Socket s;
+            s.connect("127.0.0.1", PORT);
+            Message m{};
+            Buffer buf;
+            for (int i = 0; i < N; ++ i)
+            {
+                m.id = i;
+                buf.assign(reinterpret_cast<const char*>(&m), sizeof(m));
+                s.write(buf);
+            }
+        });
+        net::Socket s = acceptor.accept();
+        Buffer buf;
+        for (int i = 0; i < N; ++ i)
+        {
+            buf.resize(sizeof(Message));
+            s.read(buf);
+            Message m;
+            std::memcpy(&m, buf.data(), sizeof(m));
+            socketSum += m.id;
+        }
+    });
+    waitForAll();
+    double socketTime = secondsSince(start);
+    VERIFY(socketSum == SUM, "Invalid socket sum");
+    RTLOG("shm: " << N / shmTime << " msg/s, socket: " << N / socketTime
+        << " msg/s, ratio: " << socketTime / shmTime);
+#endif
+}
+
 void cycle1()
 {
     int threads = std::thread::hardware_concurrency();
@@ -22,6 +22,26 @@ void pipe1();
 void pipe2();
 void pipe3();
 void pipe4();
+void bounded1();
+void ring1();
+void spsc1();
+void batch1();
+void select1();
+void try1();
+void moveOnly1();
+void fair1();
+void metrics1();
+void broadcast1();
+void spill1();
+void producers1();
+void pipeline1();
+void ordered1();
+void reduce1();
+void keyed1();
+void adaptive1();
+void batched1();
+void profile1();
+void shm1();
 void cycle1();
 
 }
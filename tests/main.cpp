@@ -36,12 +36,37 @@
     TEST_ITERATOR(test::timeout2)  \
     TEST_ITERATOR(test::portal1)   \
     TEST_ITERATOR(test::portal2)   \
+    TEST_ITERATOR(test::portalAsync1)  \
+    TEST_ITERATOR(test::combining1)    \
+    TEST_ITERATOR(test::rcu1)  \
+    TEST_ITERATOR(test::stats1)    \
+    TEST_ITERATOR(test::bound1)    \
     TEST_ITERATOR(test::gc1)   \
     TEST_ITERATOR(test::tp1)   \
     TEST_ITERATOR(data::pipe1) \
     TEST_ITERATOR(data::pipe2) \
     TEST_ITERATOR(data::pipe3) \
     TEST_ITERATOR(data::pipe4) \
+    TEST_ITERATOR(data::bounded1)  \
+    TEST_ITERATOR(data::ring1) \
+    TEST_ITERATOR(data::spsc1) \
+    TEST_ITERATOR(data::batch1) \
+    TEST_ITERATOR(data::select1) \
+    TEST_ITERATOR(data::try1) \
+    TEST_ITERATOR(data::moveOnly1) \
+    TEST_ITERATOR(data::fair1) \
+    TEST_ITERATOR(data::metrics1) \
+    TEST_ITERATOR(data::broadcast1) \
+    TEST_ITERATOR(data::spill1)    \
+    TEST_ITERATOR(data::producers1) \
+    TEST_ITERATOR(data::pipeline1) \
+    TEST_ITERATOR(data::ordered1)  \
+    TEST_ITERATOR(data::reduce1)   \
+    TEST_ITERATOR(data::keyed1)    \
+    TEST_ITERATOR(data::adaptive1) \
+    TEST_ITERATOR(data::batched1)  \
+    TEST_ITERATOR(data::profile1)  \
+    TEST_ITERATOR(data::shm1)      \
     TEST_ITERATOR(data::cycle1)    \
 
 int main(int argc, char* argv[])
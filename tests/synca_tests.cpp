@@ -16,11 +16,25 @@
 
 #include "core.h"
 #include "portal.h"
+#include "combiner.h"
+#include "rcu.h"
+#include "stats.h"
 #include "helpers.h"
 #include "gc.h"
 
 namespace test {
 
+struct BoundStorage
+{
+    int op(int v)           { return v * 2; }
+};
+
+}
+
+BIND_SCHEDULER(test::BoundStorage, Alone)
+
+namespace test {
+
 using namespace mt;
 using namespace synca;
 
@@ -312,6 +326,192 @@ void portal2()
     waitForAll();
 }
 
+void portalAsync1()
+{
+    ThreadPool tp1(1, "tp1");
+    ThreadPool tp2(1, "tp2");
+    Alone a(tp2);
+
+    struct X
+    {
+        int op(int v)       { sleepFor(200); return v + 1; }
+    };
+
+    struct Y
+    {
+        void op()           { sleepFor(200); }
+        int fail()          { throw std::runtime_error("Y fails"); }
+    };
+
+    portal<X>().attach(tp2);
+    portal<Y>().attach(a);
+    go([] {
+        Future<int> x = portal<X>().async(&X::op, 1);
+        Future<void> y = portal<Y>().async(&Y::op);
+        Future<int> e = portal<Y>().async(&Y::fail);
+        JLOG("calls started");
+        y.get();
+        JLOG("x: " << x.get());
+        try
+        {
+            e.get();
+        }
+        catch (std::exception& ex)
+        {
+            (void) ex;
+            JLOG("exception: " << ex.what());
+        }
+    }, tp1);
+    waitForAll();
+}
+
+struct Cache
+{
+    int get(int key)
+    {
+        ++ gets;
+        return key * 2;
+    }
+
+    std::vector<int> batchGet(const std::vector<int>& keys)
+    {
+        ++ batches;
+        std::vector<int> values;
+        for (int key: keys)
+            values.push_back(key * 2);
+        return values;
+    }
+
+    int inc()
+    {
+        return ++ counter;
+    }
+
+    int counter = 0;
+    int gets = 0;
+    int batches = 0;
+};
+
+void combining1()
+{
+    const int N = 10000;
+
+    ThreadPool tp(std::thread::hardware_concurrency(), "tp");
+    Alone a(tp);
+    scheduler<DefaultTag>().attach(tp);
+    portal<Cache>().attach(a);
+    combiningPortal<Cache>().attach(a);
+
+    auto start = std::chrono::steady_clock::now();
+    goN(N, [] {
+        portal<Cache>()->inc();
+    });
+    waitForAll();
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    RTLOG("portal calls: " << single<Cache>().counter << ", ms: " << ms);
+
+    start = std::chrono::steady_clock::now();
+    goN(N, [] {
+        combiningPortal<Cache>().call(&Cache::inc);
+        int v = combiningPortal<Cache>().get(5);
+        VERIFY(v == 10, "Invalid batched value");
+    });
+    waitForAll();
+    ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    Cache& c = single<Cache>();
+    RTLOG("combining calls: " << c.counter << ", batches: " << c.batches << ", ms: " << ms);
+    VERIFY(c.counter == 2 * N, "Invalid calls amount");
+    VERIFY(c.gets == 0, "batchGet must be used");
+}
+
+struct Routes
+{
+    int version = 0;
+    std::vector<int> routes = std::vector<int>(16, 0);
+};
+
+void rcu1()
+{
+    ThreadPool tp(3, "tp");
+    Alone a(tp);
+    scheduler<DefaultTag>().attach(tp);
+    rcuPortal<Routes>().attach(a);
+
+    std::atomic<int> reads(0);
+    goN(10, [&reads] {
+        for (int i = 0; i < 10000; ++ i)
+        {
+            auto routes = rcuPortal<Routes>().read();
+            for (int r: routes->routes)
+                VERIFY(r == routes->version, "Inconsistent snapshot");
+            ++ reads;
+        }
+    });
+    goN(3, [] {
+        for (int i = 0; i < 100; ++ i)
+        {
+            rcuPortal<Routes>().update([](Routes& r) {
+                ++ r.version;
+                for (int& v: r.routes)
+                    v = r.version;
+            });
+        }
+    });
+    waitForAll();
+    RTLOG("reads: " << reads << ", version: " << rcuPortal<Routes>()->version);
+    VERIFY(rcuPortal<Routes>()->version == 300, "Invalid updates amount");
+}
+
+void stats1()
+{
+    ThreadPool tp1(2, "tp1");
+    ThreadPool tp2(2, "tp2");
+    Alone a(tp2, "disk");
+
+    struct Disk
+    {
+        void op() { sleepFor(10); }
+    };
+
+    portal<Disk>().attach(a);
+    scheduler<DefaultTag>().attach(tp1);
+    goN(20, [] {
+        portal<Disk>()->op();
+    });
+    waitForAll();
+
+    // the handlers queued on the destroyed scheduler keep its statistics
+    std::atomic<int> done{0};
+    {
+        Alone b(tp2, "transient");
+        b.schedule([] { std::this_thread::sleep_for(std::chrono::milliseconds(50)); });
+        for (int i = 0; i < 10; ++ i)
+            b.schedule([&done] { ++ done; });
+    }
+    WAIT_FOR(done == 10);
+    stats::dump();
+}
+
+void bound1()
+{
+    ThreadPool tp1(1, "tp1");
+    ThreadPool tp2(1, "tp2");
+    Alone a(tp2, "storage");
+
+    Binding<BoundStorage>::attach(a);
+    go([] {
+        int v = boundPortal<BoundStorage>()->op(1);
+        JLOG("value: " << v);
+        v = boundPortal<BoundStorage>().async(&BoundStorage::op, 2).get();
+        JLOG("async value: " << v);
+    }, tp1);
+    waitForAll();
+    // the bound scheduler must not outlive the test
+    Binding<BoundStorage>::detach();
+}
+
 void gc1()
 {
     struct A   { ~A() { TLOG("~A"); } };
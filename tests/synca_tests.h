@@ -33,6 +33,11 @@ void timeout1();
 void timeout2();
 void portal1();
 void portal2();
+void portalAsync1();
+void combining1();
+void rcu1();
+void stats1();
+void bound1();
 void gc1();
 void tp1();
 